@@ -10,20 +10,765 @@
  */
 
 #include "qft2xx.h"
+
+/* Reader thread
+ *
+ * Used when threaded receive is enabled. Waits on the
+ * FTD2XX event handle, drains the device into the chunks
+ * of a lock-free queue and wakes up the owner thread to
+ * collect them. Modem status and errors are only flagged,
+ * they are handled in the owner thread.
+ *
+ * On Linux there is no QWinEventNotifier, so without
+ * threaded receive the same thread runs in notify only
+ * mode: it just waits on the event handle and lets the
+ * owner thread run on_FTDIevent().
+ */
+class FT232ReaderThread : public QThread
+{
+public:
+    FT232ReaderThread(FT232 *device, bool notifyOnly = false)
+        : queue(notifyOnly ? 1 : FTDI_READER_CHUNKS, notifyOnly ? 0 : FTDI_READER_CHUNK_SIZE),
+          device(device), notifyOnly(notifyOnly) {}
+    void stop();
+
+    FT232ChunkQueue queue;
+    QAtomicInt notifyPending;
+    QAtomicInt modemPending;
+    QAtomicInt errorPending;
+
+protected:
+    void run();
+
+private:
+    bool waitForEvent(int msecs);
+    void runNotifyOnly();
+
+    FT232 *device;
+    bool notifyOnly;
+    QAtomicInt stopRequested;
+};
+
+/* Ask the thread to quit and wake it up
+ */
+void FT232ReaderThread::stop()
+{
+#ifdef _WIN32
+    stopRequested.storeRelease(1);
+    SetEvent(device->ftdiEvent);
+#else
+    /* Set the flag under the event mutex, so it
+     * cannot slip in before the thread starts waiting
+     */
+    pthread_mutex_lock(&device->ftdiEvent.eMutex);
+    stopRequested.storeRelease(1);
+    pthread_cond_signal(&device->ftdiEvent.eCondVar);
+    pthread_mutex_unlock(&device->ftdiEvent.eMutex);
+#endif
+}
+
+/* Wait up to msecs for the FTD2XX event.
+ * Returns true if it was signaled
+ */
+bool FT232ReaderThread::waitForEvent(int msecs)
+{
+#ifdef _WIN32
+    return WaitForSingleObject(device->ftdiEvent, msecs) == WAIT_OBJECT_0;
+#else
+    struct timespec deadline;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += msecs / 1000;
+    deadline.tv_nsec += (msecs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&device->ftdiEvent.eMutex);
+    if (!stopRequested.loadAcquire())
+        rc = pthread_cond_timedwait(&device->ftdiEvent.eCondVar, &device->ftdiEvent.eMutex, &deadline);
+    pthread_mutex_unlock(&device->ftdiEvent.eMutex);
+
+    return rc == 0;
+#endif
+}
+
+void FT232ReaderThread::run()
+{
+    DWORD EventDWord;
+    DWORD RxBytes = 0;
+    DWORD TxBytes;
+    DWORD bytesReturned;
+    FT_STATUS ret;
+
+    if (notifyOnly) {
+        runNotifyOnly();
+        return;
+    }
+
+    while (!stopRequested.loadAcquire())
+    {
+        /* If the queue was full last time, poll until the
+         * owner thread makes room. Otherwise sleep until the
+         * next event
+         */
+        bool signaled = waitForEvent(RxBytes > 0 ? 1 : FTDI_EVENT_TIMEOUT);
+        if (stopRequested.loadAcquire())
+            break;
+
+        /* A stream engine reads the device meanwhile */
+        if (device->FTDIclaimed.loadAcquire()) {
+            RxBytes = 0;
+            continue;
+        }
+#ifdef _WIN32
+        /* Windows events are latched, nothing was missed */
+        if (!signaled && RxBytes == 0)
+            continue;
+#else
+        /* A condition signaled while we were busy is lost,
+         * so check the device on timeouts too
+         */
+        Q_UNUSED(signaled);
+#endif
+
+        bool notify = false;
+
+        /* Use mutex here to avoid reading
+         * while the owner is writing or configuring
+         */
+        device->ftdiMutex.lock();
+        ret = FT_GetStatus(device->ftdi, &RxBytes, &TxBytes, &EventDWord);
+        if (ret == FT_OK)
+        {
+            if (EventDWord & FT_EVENT_MODEM_STATUS)
+            {
+                modemPending.storeRelease(1);
+                notify = true;
+            }
+
+            /* Drain the device while there are free chunks */
+            while (RxBytes > 0)
+            {
+                char *slot = queue.writeSlot();
+                if (!slot)
+                    break;
+
+                DWORD n = qMin((qint64)RxBytes, queue.chunkSize());
+                ret = FT_Read(device->ftdi, slot, n, &bytesReturned);
+                if (ret != FT_OK || bytesReturned == 0)
+                    break;
+
+                queue.publish(bytesReturned);
+                RxBytes -= bytesReturned;
+                notify = true;
+
+                /* Bytes keep arriving while we read, drain
+                 * until the device queue is empty
+                 */
+                if (RxBytes == 0 && FT_GetQueueStatus(device->ftdi, &RxBytes) != FT_OK)
+                    RxBytes = 0;
+            }
+        }
+        device->ftdiMutex.unlock();
+
+        if (ret != FT_OK)
+        {
+            RxBytes = 0;
+            errorPending.storeRelease(1);
+            notify = true;
+        }
+
+        /* Wake up the owner thread, unless it is already
+         * due to collect the data
+         */
+        if (notify && notifyPending.testAndSetOrdered(0, 1))
+            QMetaObject::invokeMethod(device, "on_FTDIreaderData", Qt::QueuedConnection);
+    }
+}
+
+/* Notify only loop: wait for the event and queue
+ * on_FTDIevent() in the owner thread
+ */
+void FT232ReaderThread::runNotifyOnly()
+{
+    DWORD RxBytes;
+    FT_STATUS ret;
+
+    while (!stopRequested.loadAcquire())
+    {
+        bool signaled = waitForEvent(FTDI_EVENT_TIMEOUT);
+        if (stopRequested.loadAcquire())
+            break;
+        if (device->FTDIclaimed.loadAcquire())
+            continue;
+
+        /* Lost wakeups are caught by looking at the
+         * receive queue on timeouts
+         */
+        if (!signaled)
+        {
+            device->ftdiMutex.lock();
+            ret = FT_GetQueueStatus(device->ftdi, &RxBytes);
+            device->ftdiMutex.unlock();
+
+            if (ret != FT_OK || RxBytes == 0)
+                continue;
+        }
+
+        /* Owner clears the flag in on_FTDIevent() */
+        if (notifyPending.testAndSetOrdered(0, 1))
+            QMetaObject::invokeMethod(device, "on_FTDIevent", Qt::QueuedConnection);
+    }
+}
+
+/* Writer thread
+ *
+ * Used when buffered write is enabled. writeData() only
+ * queues the data and this thread hands it to FT_Write,
+ * so the caller never blocks on flow control or write
+ * timeouts. Progress is reported to the owner thread,
+ * which emits bytesWritten().
+ *
+ * With write coalescing, writes queued within the window
+ * (or until flush()) are merged into one transfer of up to
+ * the coalescing limit, so header, payload and CRC written
+ * separately go out in a single USB transaction.
+ *
+ * With transmit pacing, a token bucket splits transfers
+ * into bursts and schedules them at the configured rate,
+ * for receivers with small FIFOs and no flow control.
+ *
+ * Each priority has its own lane. Higher lanes are written
+ * first, but only between whole writes: a write() or the
+ * parts of a writeV() are never split by another lane, so
+ * framing on the wire stays intact. A control frame gets
+ * ahead of bulk data once the write in progress is done,
+ * bulk data written in chunks lets it in sooner. A single
+ * large bulk write() is not preempted: the control frame
+ * waits until all of it was written.
+ */
+class FT232WriterThread : public QThread
+{
+public:
+    FT232WriterThread(FT232 *device);
+    void enqueue(const QByteArray &data, int lane = 0);
+    qint64 enqueue(const QList<QByteArray> &parts, int lane = 0);
+    void stop();
+
+    /* One transmit lane. Lanes are served from the highest
+     * down, switching only between whole writes
+     */
+    struct Lane {
+        QList<QByteArray> queue;
+        QList<qint64> queuedAt;
+        /* Item is followed by another part of its writeV() */
+        QList<bool> continued;
+        /* Part of a writeV() taken, the rest not yet */
+        bool groupOpen = false;
+        qint64 queueOffset = 0;
+        qint64 queuedBytes = 0;
+        QElapsedTimer queuedSince;
+        QVector<quint64> delays;
+
+        /* Transfer in progress: a queued item as is,
+         * or several merged into mergeBuffer
+         */
+        QByteArray currentItem;
+        QByteArray mergeBuffer;
+        const char *currentData = nullptr;
+        qint64 currentSize = 0;
+        qint64 currentOffset = 0;
+    };
+
+    /* Queue state, protected by mutex */
+    QMutex mutex;
+    QWaitCondition queueCondition;
+    QWaitCondition writtenCondition;
+    Lane lanes[FTDI_WRITE_LANES];
+    quint64 writtenTotal = 0;
+    bool writeFailed = false;
+    bool flushRequested = false;
+
+    QAtomicInteger<qint64> pendingBytes;
+    QAtomicInteger<qint64> unreportedBytes;
+    QAtomicInt notifyPending;
+    QAtomicInt errorPending;
+    QAtomicInt timeoutPending;
+
+protected:
+    void run();
+
+private:
+    int nextLane() const;
+    void waitForCoalescing(Lane &lane);
+    void takeTransfer(Lane &lane);
+    void recordDelay(Lane &lane);
+    qint64 dropGroup(Lane &lane);
+    qint64 pace(qint64 len);
+    void notify();
+
+    FT232 *device;
+    bool stopRequested = false;
+    QElapsedTimer clock;
+
+    /* Token bucket of transmit pacing */
+    double tokens = 0;
+    QElapsedTimer bucketClock;
+};
+
+FT232WriterThread::FT232WriterThread(FT232 *device)
+    : device(device)
+{
+    for (Lane &lane : lanes)
+        lane.delays.fill(0, FTDI_DELAY_BUCKETS);
+    clock.start();
+}
+
+/* Queue data for writing on a lane and wake the thread up
+ */
+void FT232WriterThread::enqueue(const QByteArray &data, int lane)
+{
+    Lane &l = lanes[lane];
+
+    mutex.lock();
+    if (l.queue.isEmpty())
+        l.queuedSince.start();
+    l.queue.append(data);
+    l.queuedAt.append(clock.nsecsElapsed());
+    l.continued.append(false);
+    l.queuedBytes += data.size();
+    pendingBytes.fetchAndAddOrdered(data.size());
+    queueCondition.wakeOne();
+    mutex.unlock();
+}
+
+/* Queue several parts under one lock as one group:
+ * they stay together in the queue and no other lane
+ * is written in between. Returns the total size
+ */
+qint64 FT232WriterThread::enqueue(const QList<QByteArray> &parts, int lane)
+{
+    Lane &l = lanes[lane];
+    qint64 total = 0;
+    int last = parts.size() - 1;
+
+    while (last >= 0 && parts.at(last).isEmpty())
+        last--;
+    if (last < 0)
+        return 0;
+
+    mutex.lock();
+    if (l.queue.isEmpty())
+        l.queuedSince.start();
+    qint64 now = clock.nsecsElapsed();
+    for (int i = 0; i <= last; i++) {
+        const QByteArray &part = parts.at(i);
+        if (part.isEmpty())
+            continue;
+        l.queue.append(part);
+        l.queuedAt.append(now);
+        l.continued.append(i < last);
+        total += part.size();
+    }
+    l.queuedBytes += total;
+    pendingBytes.fetchAndAddOrdered(total);
+    queueCondition.wakeOne();
+    mutex.unlock();
+
+    return total;
+}
+
+/* Ask the thread to quit once the queue is written
+ */
+void FT232WriterThread::stop()
+{
+    mutex.lock();
+    stopRequested = true;
+    queueCondition.wakeOne();
+    mutex.unlock();
+}
+
+/* Wake up the owner thread, unless it is already
+ * due to report progress
+ */
+void FT232WriterThread::notify()
+{
+    if (notifyPending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(device, "on_FTDIwriterProgress", Qt::QueuedConnection);
+}
+
+/* Returns the lane to write next, -1 if there is nothing
+ * to write. A lane in the middle of a write (a transfer in
+ * progress, an item partly taken or an open writeV() group)
+ * keeps the wire until it is done, otherwise the highest
+ * lane with queued data goes first
+ *
+ * Called with mutex held
+ */
+int FT232WriterThread::nextLane() const
+{
+    for (int i = FTDI_WRITE_LANES - 1; i >= 0; i--) {
+        const Lane &l = lanes[i];
+        if (l.currentOffset < l.currentSize || l.queueOffset > 0 || l.groupOpen)
+            return i;
+    }
+
+    for (int i = FTDI_WRITE_LANES - 1; i >= 0; i--) {
+        if (!lanes[i].queue.isEmpty())
+            return i;
+    }
+
+    return -1;
+}
+
+/* Give following writes the coalescing window to join
+ * the oldest queued one. Returns early once a full
+ * transfer is queued, on flush(), on stop or when a
+ * higher lane has data
+ *
+ * Called with mutex held
+ */
+void FT232WriterThread::waitForCoalescing(Lane &lane)
+{
+    while (!flushRequested && !stopRequested && nextLane() == &lane - lanes &&
+           lane.queuedBytes < device->FTDIcoalescingLimit)
+    {
+        qint64 remaining = device->FTDIcoalescingWindow - lane.queuedSince.nsecsElapsed() / 1000;
+        if (remaining <= 0)
+            break;
+
+        /* Wait in milliseconds, sleep out the last one */
+        if (remaining >= 1000) {
+            queueCondition.wait(&mutex, remaining / 1000);
+        } else {
+            mutex.unlock();
+            QThread::usleep(remaining);
+            mutex.lock();
+        }
+    }
+}
+
+/* Count the queueing delay of the lane's oldest item
+ * in the histogram: bucket 0 holds delays below 2 us,
+ * bucket i those from 2^i to 2^(i+1) us, the last one
+ * everything longer
+ *
+ * Called with mutex held
+ */
+void FT232WriterThread::recordDelay(Lane &lane)
+{
+    qint64 usecs = (clock.nsecsElapsed() - lane.queuedAt.first()) / 1000;
+    int bucket = 0;
+
+    while (usecs > 1 && bucket < FTDI_DELAY_BUCKETS - 1) {
+        usecs >>= 1;
+        bucket++;
+    }
+    lane.delays[bucket]++;
+}
+
+/* Take the next transfer off a lane. Without coalescing,
+ * or when the oldest item alone fills a transfer, it is sent
+ * as is. Otherwise items are copied into mergeBuffer up to
+ * the coalescing limit; an item that does not fit is split
+ * and its remainder starts the next transfer
+ *
+ * Called with mutex held
+ */
+void FT232WriterThread::takeTransfer(Lane &lane)
+{
+    qint64 limit = device->FTDIcoalescingLimit;
+
+    lane.currentOffset = 0;
+
+    if (!device->FTDIwriteCoalescing || lane.queue.first().size() - lane.queueOffset >= limit) {
+        if (lane.queueOffset == 0)
+            recordDelay(lane);
+        lane.currentItem = lane.queue.takeFirst();
+        lane.queuedAt.removeFirst();
+        lane.groupOpen = lane.continued.takeFirst();
+        lane.currentData = lane.currentItem.constData() + lane.queueOffset;
+        lane.currentSize = lane.currentItem.size() - lane.queueOffset;
+        lane.queueOffset = 0;
+    } else {
+        int merged = 0;
+
+        if (lane.mergeBuffer.size() < limit)
+            lane.mergeBuffer.resize(limit);
+        lane.currentItem.clear();
+        lane.currentSize = 0;
+
+        while (!lane.queue.isEmpty() && lane.currentSize < limit) {
+            const QByteArray &item = lane.queue.first();
+            qint64 avail = item.size() - lane.queueOffset;
+            qint64 n = qMin(avail, limit - lane.currentSize);
+
+            if (lane.queueOffset == 0)
+                recordDelay(lane);
+            memcpy(lane.mergeBuffer.data() + lane.currentSize, item.constData() + lane.queueOffset, n);
+            lane.currentSize += n;
+            merged++;
+
+            if (n == avail) {
+                lane.queue.removeFirst();
+                lane.queuedAt.removeFirst();
+                lane.groupOpen = lane.continued.takeFirst();
+                lane.queueOffset = 0;
+            } else {
+                lane.queueOffset += n;
+            }
+        }
+
+        lane.currentData = lane.mergeBuffer.constData();
+        if (merged > 1)
+            device->FTDItransfersSaved.fetchAndAddOrdered(merged - 1);
+    }
+
+    if (!lane.queue.isEmpty())
+        lane.queuedSince.start();
+
+    /* flush() is done once no lane has anything queued */
+    bool queued = false;
+    for (const Lane &l : lanes)
+        queued |= !l.queue.isEmpty();
+    if (!queued)
+        flushRequested = false;
+}
+
+/* Drops what is left of the lane's writeV() group after
+ * a failed write, so its other parts do not go out with
+ * a hole before them. Returns the number of bytes dropped
+ *
+ * Called with mutex held
+ */
+qint64 FT232WriterThread::dropGroup(Lane &lane)
+{
+    qint64 dropped = 0;
+
+    while (lane.groupOpen && !lane.queue.isEmpty()) {
+        dropped += lane.queue.takeFirst().size() - lane.queueOffset;
+        lane.queuedAt.removeFirst();
+        lane.groupOpen = lane.continued.takeFirst();
+        lane.queueOffset = 0;
+    }
+    lane.groupOpen = false;
+
+    return dropped;
+}
+
+/* Token bucket: wait until len bytes (at most one burst)
+ * may be written and take the tokens. Waits are precise
+ * without burning a core: the condition wait covers whole
+ * milliseconds, the rest is slept and only the last
+ * FTDI_PACING_SPIN_USECS are spun out. Returns the number
+ * of bytes to write
+ *
+ * Called with mutex held
+ */
+qint64 FT232WriterThread::pace(qint64 len)
+{
+    qint64 rate = device->FTDIpacingRate;
+    qint64 burst = qMax(device->FTDIpacingBurst, (qint64)1);
+
+    len = qMin(len, burst);
+
+    while (true)
+    {
+        /* Refill at rate bytes per second, up to one burst */
+        tokens = qMin((double)burst, tokens + bucketClock.nsecsElapsed() * (double)rate / 1e9);
+        bucketClock.start();
+        if (tokens >= len)
+            break;
+
+        qint64 waitNs = (qint64)((len - tokens) * 1e9 / rate);
+        if (waitNs > 2000000) {
+            queueCondition.wait(&mutex, (waitNs - 1000000) / 1000000);
+        } else {
+            QElapsedTimer spin;
+            spin.start();
+            mutex.unlock();
+            qint64 sleepUsecs = waitNs / 1000 - FTDI_PACING_SPIN_USECS;
+            if (sleepUsecs > 0)
+                QThread::usleep(sleepUsecs);
+            while (spin.nsecsElapsed() < waitNs)
+                QThread::yieldCurrentThread();
+            mutex.lock();
+        }
+
+        /* Pacing switched off meanwhile */
+        if (device->FTDIpacingRate <= 0)
+            return len;
+    }
+
+    tokens -= len;
+    return len;
+}
+
+void FT232WriterThread::run()
+{
+    DWORD _bytesWritten;
+    FT_STATUS ret;
+
+    /* FT_Write times out after FTDI_WRITE_SLICE_TIMEOUT, the
+     * write timeout is counted here across short writes
+     */
+    QElapsedTimer stallClock;
+    bool stalled = false;
+
+    /* Start with a full bucket */
+    tokens = device->FTDIpacingBurst;
+    bucketClock.start();
+
+    mutex.lock();
+    while (true)
+    {
+        int next = nextLane();
+        while (next < 0 && !stopRequested) {
+            queueCondition.wait(&mutex);
+            next = nextLane();
+        }
+
+        /* Stop requested and everything written */
+        if (next < 0)
+            break;
+
+        Lane &lane = lanes[next];
+
+        /* Start a new transfer once the current one is done.
+         * Only the lowest lane waits for the coalescing
+         * window, the others go out right away
+         */
+        if (lane.currentOffset >= lane.currentSize)
+        {
+            if (device->FTDIwriteCoalescing && next == 0) {
+                waitForCoalescing(lane);
+
+                /* A higher lane got data meanwhile */
+                if (nextLane() != next)
+                    continue;
+            }
+            takeTransfer(lane);
+        }
+
+        /* Write at most one coalescing limit per round, so
+         * stop and timeouts are seen during a large transfer,
+         * and split further according to transmit pacing
+         */
+        qint64 len = qMin(lane.currentSize - lane.currentOffset, device->FTDIcoalescingLimit);
+        bool paced = device->FTDIpacingRate > 0;
+        if (paced)
+            len = pace(len);
+
+        bool stopping = stopRequested;
+        int writeTimeout = device->FTDIwriteTimeout;
+        mutex.unlock();
+
+        if (!stalled)
+            stallClock.start();
+
+        /* Write outside of the queue lock
+         *
+         * Use mutex here to avoid writing
+         * while the event handler is reading.
+         * The driver write timeout is one slice,
+         * so it is never held for long
+         */
+        device->ftdiMutex.lock();
+        ret = FT_Write(device->ftdi, (char *)lane.currentData + lane.currentOffset, len, &_bytesWritten);
+        device->ftdiMutex.unlock();
+
+        mutex.lock();
+        /* Unwritten bytes give their tokens back */
+        if (paced)
+            tokens += len - (ret == FT_OK ? _bytesWritten : 0);
+
+        qint64 done = _bytesWritten;
+        if (ret != FT_OK) {
+            /* Drop the rest of this transfer and of
+             * its writeV() group, and report
+             */
+            done = lane.currentSize - lane.currentOffset;
+            qint64 dropped = dropGroup(lane);
+            lane.queuedBytes -= dropped;
+            pendingBytes.fetchAndAddOrdered(-dropped);
+            _bytesWritten = 0;
+            writeFailed = true;
+            errorPending.storeRelease(1);
+        }
+
+        /* A short write ends a slice, the rest is retried on
+         * the next round. Once no slice went through for the
+         * write timeout, it is reported like a blocking write
+         */
+        bool timedOut = false;
+        stalled = ret == FT_OK && (qint64)_bytesWritten < len;
+        if (stalled && stallClock.elapsed() >= writeTimeout) {
+            timeoutPending.storeRelease(1);
+            timedOut = true;
+            stallClock.start();
+        }
+        lane.currentOffset += done;
+        lane.queuedBytes -= done;
+        pendingBytes.fetchAndAddOrdered(-done);
+
+        if (_bytesWritten > 0) {
+            writtenTotal += _bytesWritten;
+            unreportedBytes.fetchAndAddOrdered(_bytesWritten);
+        }
+        writtenCondition.wakeAll();
+
+        if (_bytesWritten > 0 || ret != FT_OK || timeoutPending.loadAcquire()) {
+            mutex.unlock();
+            notify();
+            mutex.lock();
+        }
+
+        /* When closing, give up if the device does not
+         * take any more data
+         */
+        if (stopping && timedOut && _bytesWritten == 0) {
+            pendingBytes.storeRelease(0);
+            for (Lane &l : lanes) {
+                l.queue.clear();
+                l.queuedAt.clear();
+                l.continued.clear();
+                l.groupOpen = false;
+                l.queueOffset = l.queuedBytes = 0;
+                l.currentSize = l.currentOffset = 0;
+            }
+            break;
+        }
+    }
+    for (Lane &l : lanes) {
+        l.currentItem.clear();
+        l.currentSize = l.currentOffset = 0;
+    }
+    mutex.unlock();
+}
+
 /* Class constructor
  */
 FT232::FT232(QObject *parent)
-	: QIODevice (parent)
+	: QIODevice (parent), readyReadTimer(this)
 {
-
+    /* Fires the delayed readyRead() of coalesced delivery.
+     * Child of this object, so moveToThread() moves it too
+     */
+    readyReadTimer.setSingleShot(true);
+    readyReadTimer.setTimerType(Qt::PreciseTimer);
+    connect(&readyReadTimer, &QTimer::timeout, this, &FT232::on_FTDIdeliveryTimeout);
 }
 
-/* Releases FT_HANDLE and deletes ftdiEventNotifier
+/* Stops event notification and releases FT_HANDLE
  */
 FT232::~FT232()
 {
+    stopWriter();
+    stopEventNotification();
     FT_Close(ftdi);
-    delete ftdiEventNotifier;
 }
 
 /* Open FT232 and sets basic parameters:
@@ -78,6 +823,18 @@ bool FT232::open(QIODevice::OpenMode mode)
 		return false;
 	}
 
+    /* Hi-Speed chips have 512 byte bulk packets, the others 64.
+     * Coalesced writes are sized to a number of packets
+     */
+    FT_DEVICE deviceType;
+    DWORD usbId;
+    if (FT_GetDeviceInfo(ftdi, &deviceType, &usbId, NULL, NULL, NULL) == FT_OK &&
+        (deviceType == FT_DEVICE_2232H || deviceType == FT_DEVICE_4232H || deviceType == FT_DEVICE_232H))
+        FTDIpacketSize = 512;
+    else
+        FTDIpacketSize = 64;
+    FTDIcoalescingLimit = FTDIpacketSize * FTDI_COALESCING_PACKETS;
+
     ret = FT_SetBaudRate(ftdi, FTDIbaudRate);
     if (ret != FT_OK) {
         setErrorString(tr("an error occured while setting the baudrate"));
@@ -85,14 +842,52 @@ bool FT232::open(QIODevice::OpenMode mode)
 		return false;
 	}
 
-    ret = FT_SetLatencyTimer(ftdi, FTDI_LATENCY);
+    /* Adaptive latency starts out interactive */
+    FTDIcurrentLatency = FTDIadaptiveLatency ? FTDIlatencyLow : FTDIlatencyTimer;
+    latencyInterval.invalidate();
+    latencyBytes = 0;
+    latencyWritten.storeRelease(0);
+    ret = FT_SetLatencyTimer(ftdi, FTDIcurrentLatency);
     if (ret != FT_OK) {
         setErrorString(tr("an error occured while setting the latency timer"));
         close();
         return false;
     }
 
-    ret = FT_SetTimeouts(ftdi,5000,2000);
+    /* Once applySettings() was used, the whole set is applied
+     * at open(): baud rate, latency and timeouts are set
+     * above, the rest here
+     */
+    if (applySettingsAtOpen) {
+        ftdiMutex.lock();
+        QString error = writeLineSettings(settings(), nullptr);
+        ftdiMutex.unlock();
+        if (!error.isEmpty()) {
+            setErrorString(error);
+            close();
+            return false;
+        }
+    }
+
+    /* Event and error characters, disabled unless set */
+    ret = FT_SetChars(ftdi, FTDIeventChar, FTDIeventCharEnabled, FTDIerrorChar, FTDIerrorCharEnabled);
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the event character"));
+        close();
+        return false;
+    }
+
+    /* Driver default transfer sizes unless set */
+    if (FTDIusbInSize > 0) {
+        ret = FT_SetUSBParameters(ftdi, FTDIusbInSize, FTDIusbOutSize);
+        if (ret != FT_OK) {
+            setErrorString(tr("an error occured while setting the USB transfer size"));
+            close();
+            return false;
+        }
+    }
+
+    ret = FT_SetTimeouts(ftdi, FTDIreadTimeout, driverWriteTimeout(FTDIwriteTimeout));
     if (ret != FT_OK) {
         setErrorString(tr("an error occured while setting the timeouts"));
         close();
@@ -141,25 +936,52 @@ bool FT232::open(QIODevice::OpenMode mode)
 	/* Clear buffers */
     FT_Purge(ftdi, FT_PURGE_RX | FT_PURGE_TX);
 
-	/* Notify parent class we are open*/
-	QIODevice::open(mode);
-
-    /* Create event handler and QWinEventNotifier for the receive and modem status events */
-    HANDLE hEvent = CreateEvent(NULL, false, false, NULL);
-    ftdiEventNotifier = new QWinEventNotifier(hEvent);
-
-    ret = FT_SetEventNotification(ftdi, FT_EVENT_RXCHAR | FT_EVENT_MODEM_STATUS, hEvent);
+	/* Notify parent class we are open.
+	 * Our own receive buffer is the only store,
+	 * QIODevice must not buffer on top of it
+	 */
+	QIODevice::open(mode | QIODevice::Unbuffered);
+
+    /* Create event handle for the receive and modem status events */
+#ifdef _WIN32
+    ftdiEvent = CreateEvent(NULL, false, false, NULL);
+    ret = FT_SetEventNotification(ftdi, FT_EVENT_RXCHAR | FT_EVENT_MODEM_STATUS, ftdiEvent);
+#else
+    pthread_mutex_init(&ftdiEvent.eMutex, NULL);
+    pthread_cond_init(&ftdiEvent.eCondVar, NULL);
+    ftdiEventCreated = true;
+    ret = FT_SetEventNotification(ftdi, FT_EVENT_RXCHAR | FT_EVENT_MODEM_STATUS, (PVOID)&ftdiEvent);
+#endif
     if (ret != FT_OK) {
         setErrorString(tr("an error occured while setting the event notification"));
         close();
         return false;
     }
 
-    /* Enable ftdiEventNotifier */
-    ftdiEventNotifier->setEnabled(true);
+    if (FTDIthreadedReceive) {
+        /* Dedicated reader thread waits on the event handle */
+        readerThread = new FT232ReaderThread(this);
+        readerThread->start(QThread::TimeCriticalPriority);
+    } else {
+#ifdef _WIN32
+        /* Create and enable ftdiEventNotifier */
+        ftdiEventNotifier = new QWinEventNotifier(ftdiEvent);
+        ftdiEventNotifier->setEnabled(true);
+
+        /* Connect event notifications */
+        connect(ftdiEventNotifier, &QWinEventNotifier::activated, this, &FT232::on_FTDIevent);
+#else
+        /* The thread only waits and queues on_FTDIevent() */
+        readerThread = new FT232ReaderThread(this, true);
+        readerThread->start(QThread::TimeCriticalPriority);
+#endif
+    }
 
-    /* Connect event notifications */
-    connect(ftdiEventNotifier, &QWinEventNotifier::activated, this, &FT232::on_FTDIevent);
+    /* Buffered writes are handed to FT_Write by a writer thread */
+    if (FTDIbufferedWrite) {
+        writerThread = new FT232WriterThread(this);
+        writerThread->start(QThread::HighPriority);
+    }
 
     emit connected();
 
@@ -171,6 +993,14 @@ bool FT232::open(QIODevice::OpenMode mode)
  */
 void FT232::close()
 {
+    /* Send what is still queued, then stop event
+     * delivery before the handle goes away
+     */
+    stopWriter();
+    stopEventNotification();
+    readyReadTimer.stop();
+    undeliveredBytes = 0;
+
 	/* Close FTDI
 	 *
      * Use mutex here to avoid issues
@@ -187,479 +1017,2095 @@ void FT232::close()
 }
 
 
-/* This function is called by QIODevice::read()
+/* Stops the reader thread or the event notifier
+ * and releases the event handle
+ *
+ * The driver is disarmed first: until then its own thread
+ * may signal the event, which must not be gone by then (on
+ * Windows a closed handle value can be reused by another
+ * object the driver would then signal)
  */
-qint64 FT232::readData(char *data, qint64 maxSize)
+void FT232::stopEventNotification()
 {
-	/* Check bounds */
-	qint64 n = qMin(maxSize, (qint64)FTDIreadBuffer.size());
+#ifdef _WIN32
+    if (ftdiEvent) {
+        ftdiMutex.lock();
+        FT_SetEventNotification(ftdi, 0, ftdiEvent);
+        ftdiMutex.unlock();
+    }
+#else
+    if (ftdiEventCreated) {
+        ftdiMutex.lock();
+        FT_SetEventNotification(ftdi, 0, (PVOID)&ftdiEvent);
+        ftdiMutex.unlock();
+    }
+#endif
+
+    if (readerThread) {
+        readerThread->stop();
+        readerThread->wait();
+        delete readerThread;
+        readerThread = nullptr;
+    }
+
+#ifdef _WIN32
+    if (ftdiEventNotifier) {
+        ftdiEventNotifier->setEnabled(false);
+        delete ftdiEventNotifier;
+        ftdiEventNotifier = nullptr;
+    }
 
-	/* No data, return immediately */
-	if (!n)
-		return 0;
+    if (ftdiEvent) {
+        CloseHandle(ftdiEvent);
+        ftdiEvent = NULL;
+    }
+#else
+    if (ftdiEventCreated) {
+        pthread_cond_destroy(&ftdiEvent.eCondVar);
+        pthread_mutex_destroy(&ftdiEvent.eMutex);
+        ftdiEventCreated = false;
+    }
+#endif
+}
 
-	/* Try to catch n bytes */
-	if (!sem.tryAcquire(n))
-		return 0;
 
-	/* Copy data to QIODevice provided buffer */
-	memcpy(data, FTDIreadBuffer.data(), n);
+/* This function is called by QIODevice::read()
+ */
+qint64 FT232::readData(char *data, qint64 maxSize)
+{
+	/* Copy up to maxSize bytes to QIODevice provided
+	 * buffer and drop them from my buffer
+	 */
+	qint64 n = FTDIreadBuffer.read(data, maxSize);
 
-	/* Erase data from my buffer */
-	FTDIreadBuffer.remove(0, n);
+	/* Release backpressure once drained */
+	if (rxThrottled)
+		updateThrottle();
 
 	return n;
 }
 
-/* This function is called by QIODevice::write()
+/* Stops the writer thread once everything queued
+ * was written or the device stopped taking data
  */
-qint64 FT232::writeData(const char *data, qint64 maxSize)
+void FT232::stopWriter()
 {
-    FT_STATUS ret;
-    DWORD _bytesWritten;
-	/* Write to FTDI
-	 *
-	 * Use mutex here to avoid writing
-     * while the event handler is reading
-	 */
+    if (!writerThread)
+        return;
 
-	ftdiMutex.lock();
-    ret = FT_Write(ftdi, (char *)data, maxSize, &_bytesWritten);
-	ftdiMutex.unlock();
+    writerThread->stop();
+    writerThread->wait();
+    delete writerThread;
+    writerThread = nullptr;
+}
 
-	/* If error, setErrorString */
-    if (ret != FT_OK) {
-        setErrorString(tr("an error occured while writing to the port"));
-		return -1;
-	}
+/* This function is called by QIODevice::readLine()
+ * Finds the end of line in place and reads up to it
+ */
+qint64 FT232::readLineData(char *data, qint64 maxSize)
+{
+    ReadSpans spans = readSpans(maxSize);
+    const char *eol;
+    qint64 n = spans.size();
 
-	return _bytesWritten;
+    eol = (const char *)memchr(spans.first.data, '\n', spans.first.size);
+    if (eol)
+        n = eol - spans.first.data + 1;
+    else if ((eol = (const char *)memchr(spans.second.data, '\n', spans.second.size)) != nullptr)
+        n = spans.first.size + (eol - spans.second.data) + 1;
+
+    return readData(data, n);
 }
 
-bool FT232::setBaudRate(qint32 baud)
+/* Returns true if a complete line is buffered
+ */
+bool FT232::canReadLine() const
 {
-    FT_STATUS ret;
-	FTDIbaudRate = baud;
+    ReadSpans spans = readSpans();
 
-    /* If we are not open, just return */
-    if(!isOpen()) return true;
+    return memchr(spans.first.data, '\n', spans.first.size) ||
+           memchr(spans.second.data, '\n', spans.second.size) ||
+           QIODevice::canReadLine();
+}
 
-	/* Change baud rate
-	 *
-	 * Use mutex here to avoid changing
-     * while the event handler is reading
-	 */
-	ftdiMutex.lock();
-    ret = FT_SetBaudRate(ftdi, FTDIbaudRate);
-	ftdiMutex.unlock();
+/* Returns up to maxSize received bytes as one or two
+ * contiguous views into the receive buffer, without
+ * copying or consuming them. maxSize < 0 means all.
+ *
+ * Views are valid until the data is consumed or control
+ * returns to the event loop (receiving may reallocate the
+ * buffer). Bytes put back with ungetChar() or buffered by
+ * QIODevice::peek(char *, qint64) are not included, they
+ * come first on the next read()
+ */
+FT232::ReadSpans FT232::readSpans(qint64 maxSize) const
+{
+    ReadSpans spans;
 
-	/* If error, setErrorString */
-    if (ret != FT_OK) {
-        setErrorString(tr("an error occured while setting the baudrate"));
-        close();
-        return false;
-    }
+    if (maxSize < 0)
+        maxSize = FTDIreadBuffer.size();
 
-	/* Signal baudrate has changed */
-	emit baudRateChanged(baud);
+    FTDIreadBuffer.peek(maxSize, &spans.first.data, &spans.first.size,
+                        &spans.second.data, &spans.second.size);
 
-	return true;
+    return spans;
 }
 
+/* Drops n bytes returned by readSpans() or peek().
+ * Returns the number of bytes actually dropped
+ */
+qint64 FT232::consume(qint64 n)
+{
+    n = qMin(n, FTDIreadBuffer.size());
 
-bool FT232::setLineProperty(LineProperty line)
+    if (n <= 0)
+        return 0;
+
+    FTDIreadBuffer.consume(n);
+
+    /* Release backpressure once drained */
+    if (rxThrottled)
+        updateThrottle();
+
+    return n;
+}
+
+/* Peeks up to maxSize bytes without consuming them
+ *
+ * The bytes are copied straight from the receive buffer,
+ * without the read and push back of QIODevice::peek(). The
+ * returned QByteArray owns them, use readSpans() to look at
+ * the buffer without copying
+ */
+QByteArray FT232::peek(qint64 maxSize)
+{
+    /* Pushed back bytes come first, let QIODevice handle them */
+    if (QIODevice::bytesAvailable() > 0)
+        return QIODevice::peek(maxSize);
+
+    ReadSpans spans = readSpans(maxSize);
+    QByteArray data(spans.size(), Qt::Uninitialized);
+    memcpy(data.data(), spans.first.data, spans.first.size);
+    memcpy(data.data() + spans.first.size, spans.second.data, spans.second.size);
+
+    return data;
+}
+
+/* This function is called by QIODevice::write()
+ */
+qint64 FT232::writeData(const char *data, qint64 maxSize)
 {
     FT_STATUS ret;
-    uchar bits;
-    uchar sbit;
-    uchar parity;
+    DWORD _bytesWritten;
 
-    bits = FT_BITS_8;
-	FTDIlineProperty = line;
+    /* Nothing to write: an empty write would look
+     * like a stalled device to the writer thread
+     */
+    if (maxSize <= 0)
+        return 0;
 
-	switch (line) {
-    case SERIAL_8N1: parity = FT_PARITY_NONE; sbit = FT_STOP_BITS_1; break;
-    case SERIAL_8N2: parity = FT_PARITY_NONE; sbit = FT_STOP_BITS_2; break;
-    case SERIAL_8E1: parity = FT_PARITY_EVEN; sbit = FT_STOP_BITS_1; break;
-    case SERIAL_8E2: parity = FT_PARITY_EVEN; sbit = FT_STOP_BITS_2; break;
-    case SERIAL_8O1: parity = FT_PARITY_ODD; sbit = FT_STOP_BITS_1; break;
-    case SERIAL_8O2: parity = FT_PARITY_ODD; sbit = FT_STOP_BITS_2; break;
-    case SERIAL_8M1: parity = FT_PARITY_MARK; sbit = FT_STOP_BITS_1; break;
-    case SERIAL_8M2: parity = FT_PARITY_MARK; sbit = FT_STOP_BITS_2; break;
-    case SERIAL_8S1: parity = FT_PARITY_SPACE; sbit = FT_STOP_BITS_1; break;
-    case SERIAL_8S2: parity = FT_PARITY_SPACE; sbit = FT_STOP_BITS_2; break;
-    default: parity = FT_PARITY_NONE; sbit = FT_STOP_BITS_1; break;
-	}
+    if (FTDIadaptiveLatency)
+        noteTransmitted();
 
-	/* Change line properties
+    /* Buffered write: just queue a copy,
+     * the writer thread does the rest
+     */
+    if (writerThread) {
+        writerThread->enqueue(QByteArray(data, maxSize));
+        return maxSize;
+    }
+
+	/* Write to FTDI
 	 *
-	 * Use mutex here to avoid changing
+	 * Use mutex here to avoid writing
      * while the event handler is reading
 	 */
+
 	ftdiMutex.lock();
-    ret = FT_SetDataCharacteristics(ftdi,bits,sbit,parity);
+    ret = FT_Write(ftdi, (char *)data, maxSize, &_bytesWritten);
 	ftdiMutex.unlock();
 
 	/* If error, setErrorString */
     if (ret != FT_OK) {
-        setErrorString(tr("an error occured while setting the data characteristics"));
-		return false;
+        setErrorString(tr("an error occured while writing to the port"));
+		return -1;
 	}
 
-	/* Signal line property has changed */
-	emit linePropertyChanged(line);
+	if ((qint64)_bytesWritten < maxSize)
+		reportWriteTimeout();
 
-	return true;
+	return _bytesWritten;
 }
 
-
-bool FT232::setFlowControl(FlowControl flow)
+/* Vectored write
+ *
+ * Writes all buffers as one logical transfer, without
+ * concatenating them first. Parts are never interleaved
+ * with writes from other threads: in buffered write mode
+ * they are queued together (shallow copies, nothing is
+ * copied), otherwise ftdiMutex is held over all of them.
+ *
+ * In buffered write mode, buffers made with
+ * QByteArray::fromRawData() must stay valid until written,
+ * and they are queued on the lane of the given priority.
+ * Returns the number of bytes written (or queued), -1 on error
+ */
+qint64 FT232::writeV(const QList<QByteArray> &buffers, WritePriority priority)
 {
-    FT_STATUS ret;
-	int flowctrl;
+    FT_STATUS ret = FT_OK;
+    DWORD _bytesWritten = 0;
+    qint64 total = 0;
+    bool timedOut = false;
+
+    if (!isOpen() || !(openMode() & QIODevice::WriteOnly)) {
+        setErrorString(tr("the device is not open for writing"));
+        return -1;
+    }
 
-	switch (flow) {
-    case NoFlowControl: flowctrl = FT_FLOW_NONE; break;
-    case HardwareControl: flowctrl = FT_FLOW_RTS_CTS; break;
-    case SoftwareControl: flowctrl = FT_FLOW_XON_XOFF; break;
-    case DTR_DSR_FlowControl: flowctrl = FT_FLOW_DTR_DSR; break;
-    default: flowctrl = FT_FLOW_NONE;
-	}
+    if (FTDIadaptiveLatency)
+        noteTransmitted();
 
-	/* Change flow control
+    /* Buffered write: queue the parts as they are */
+    if (writerThread)
+        return writerThread->enqueue(buffers, priority);
+
+	/* Write to FTDI
 	 *
-	 * Use mutex here to avoid changing
-     * while the event handler is reading
+	 * Keep the mutex over all parts, so other
+	 * writers cannot get in between
 	 */
-	ftdiMutex.lock();
-    ret = FT_SetFlowControl(ftdi, flowctrl, 0x11, 0x13);
-	ftdiMutex.unlock();
+    ftdiMutex.lock();
+    for (const QByteArray &part : buffers) {
+        if (part.isEmpty())
+            continue;
+
+        ret = FT_Write(ftdi, (char *)part.constData(), part.size(), &_bytesWritten);
+        if (ret != FT_OK)
+            break;
+        total += _bytesWritten;
+
+        /* Write timeout, do not send the
+         * following parts with a hole before them
+         */
+        if ((qint64)_bytesWritten < part.size()) {
+            timedOut = true;
+            break;
+        }
+    }
+    ftdiMutex.unlock();
 
 	/* If error, setErrorString */
     if (ret != FT_OK) {
-        setErrorString(tr("an error occured while setting the flow control"));
-        return false;
+        setErrorString(tr("an error occured while writing to the port"));
+		return -1;
+	}
+
+    if (timedOut)
+        reportWriteTimeout();
+
+    return total;
+}
+
+/* Write on the lane of the given priority
+ *
+ * In buffered write mode, data of a higher priority is
+ * written ahead of anything queued on lower lanes, as
+ * soon as the write in progress is complete (writes are
+ * never split by another lane). Without buffered write
+ * this is a plain write()
+ */
+qint64 FT232::writeWithPriority(const QByteArray &data, WritePriority priority)
+{
+    if (!writerThread)
+        return write(data);
+
+    if (!isOpen() || !(openMode() & QIODevice::WriteOnly)) {
+        setErrorString(tr("the device is not open for writing"));
+        return -1;
     }
 
-	FTDIflowControl = flow;
-	/* Signal flow control has changed */
-	emit flowControlChanged(flow);
+    if (FTDIadaptiveLatency)
+        noteTransmitted();
 
-	return true;
+    if (!data.isEmpty())
+        writerThread->enqueue(data, priority);
+
+    return data.size();
 }
 
+/* Returns the number of bytes queued on the lane
+ * of the given priority and not written yet
+ */
+qint64 FT232::queuedBytes(WritePriority priority) const
+{
+    if (!writerThread)
+        return 0;
 
-bool FT232::setDataTerminalReady(bool set)
+    QMutexLocker locker(&writerThread->mutex);
+    return writerThread->lanes[priority].queuedBytes;
+}
+
+/* Returns the queueing delay histogram of a lane, from
+ * write() until the data was taken off the queue: bucket 0
+ * counts delays below 2 us, bucket i delays from 2^i to
+ * 2^(i+1) us, and the last bucket everything longer
+ */
+QVector<quint64> FT232::queueDelayHistogram(WritePriority priority) const
+{
+    if (!writerThread)
+        return QVector<quint64>(FTDI_DELAY_BUCKETS, 0);
+
+    QMutexLocker locker(&writerThread->mutex);
+    return writerThread->lanes[priority].delays;
+}
+
+void FT232::resetQueueDelayHistograms()
+{
+    if (!writerThread)
+        return;
+
+    QMutexLocker locker(&writerThread->mutex);
+    for (FT232WriterThread::Lane &lane : writerThread->lanes)
+        lane.delays.fill(0);
+}
+
+bool FT232::setBaudRate(qint32 baud)
 {
     FT_STATUS ret;
+	FTDIbaudRate = baud;
 
-	/* DTR can only be set while port
-	 * is open
-	 */
-	if (!isOpen())
-		return false;
+    /* If we are not open, just return */
+    if(!isOpen()) return true;
 
-	/* Set DTR
+	/* Change baud rate
 	 *
 	 * Use mutex here to avoid changing
      * while the event handler is reading
 	 */
 	ftdiMutex.lock();
-    if(set)
-        ret = FT_SetDtr(ftdi);
-    else
-        ret = FT_ClrDtr(ftdi);
+    ret = FT_SetBaudRate(ftdi, FTDIbaudRate);
 	ftdiMutex.unlock();
 
 	/* If error, setErrorString */
     if (ret != FT_OK) {
-        setErrorString(tr("an error occured while setting the DTR"));
+        setErrorString(tr("an error occured while setting the baudrate"));
+        close();
         return false;
     }
 
-	FTDIdtr = set;
-	/* Signal DTR has changed */
-	emit dataTerminalReadyChanged(set);
+	/* Signal baudrate has changed */
+	emit baudRateChanged(baud);
 
 	return true;
 }
 
 
-bool FT232::setRequestToSend(bool set)
+/* Set the latency timer, the time the chip waits before
+ * sending a USB packet that is not full. Used as is unless
+ * adaptive latency is enabled
+ */
+bool FT232::setLatencyTimer(int msecs)
+{
+    if (msecs < FTDI_LATENCY_MIN || msecs > FTDI_LATENCY_MAX) {
+        setErrorString(tr("invalid latency timer value"));
+        return false;
+    }
+    FTDIlatencyTimer = msecs;
+
+    /* If we are not open, or adaptive latency is in control */
+    if (!isOpen() || FTDIadaptiveLatency) return true;
+
+    if (!applyLatency(msecs)) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/* Adaptive latency
+ *
+ * Switches between lowMsecs for interactive traffic and
+ * highMsecs for sustained streaming. Disabling it restores
+ * the value set with setLatencyTimer()
+ */
+bool FT232::setAdaptiveLatency(bool enable, int lowMsecs, int highMsecs)
+{
+    if (lowMsecs < FTDI_LATENCY_MIN || highMsecs > FTDI_LATENCY_MAX || lowMsecs > highMsecs) {
+        setErrorString(tr("invalid latency timer value"));
+        return false;
+    }
+    FTDIadaptiveLatency = enable;
+    FTDIlatencyLow = lowMsecs;
+    FTDIlatencyHigh = highMsecs;
+    latencyInterval.invalidate();
+    latencyBytes = 0;
+    latencyWritten.storeRelease(0);
+
+    /* If we are not open, just return */
+    if (!isOpen()) return true;
+
+    if (!applyLatency(enable ? lowMsecs : FTDIlatencyTimer)) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/* Program the latency timer, unless already set
+ */
+bool FT232::applyLatency(int msecs)
 {
     FT_STATUS ret;
 
-	/* RTS can only be set while port
-	 * is open
-	 */
-	if (!isOpen())
-		return false;
+    if (msecs == FTDIcurrentLatency)
+        return true;
 
-	/* Set RTS
-	 *
-	 * Use mutex here to avoid changing
+	/* Use mutex here to avoid changing
      * while the event handler is reading
 	 */
-	ftdiMutex.lock();
-    if(set)
-        ret = FT_SetRts(ftdi);
-    else
-        ret = FT_ClrRts(ftdi);
-	ftdiMutex.unlock();
+    ftdiMutex.lock();
+    ret = FT_SetLatencyTimer(ftdi, (UCHAR)msecs);
+    ftdiMutex.unlock();
 
 	/* If error, setErrorString */
     if (ret != FT_OK) {
-        setErrorString(tr("an error occured while setting the RTS"));
+        setErrorString(tr("an error occured while setting the latency timer"));
         return false;
     }
+    FTDIcurrentLatency = msecs;
 
-	FTDIrts = set;
-	/* Signal RTS has changed */
-	emit requestToSendChanged(set);
+    /* Signal latency timer has changed */
+    emit latencyTimerChanged(msecs);
 
-	return true;
+    return true;
 }
 
+/* Adaptive latency decision
+ *
+ * Anything written means request/response traffic: the
+ * latency timer goes down right away, so the answer is not
+ * held back in the chip. A whole interval of receiving at
+ * least half the line rate, with nothing written, is
+ * streaming: the latency timer goes up
+ */
+void FT232::adaptLatency(qint64 received, bool transmitted)
+{
+    if (transmitted) {
+        latencyWritten.storeRelease(1);
+        if (FTDIcurrentLatency != FTDIlatencyLow && applyLatency(FTDIlatencyLow))
+            latencyLowered++;
+        return;
+    }
 
-/* Parses first byte of modemStatus and returns
- * active data lines
+    latencyBytes += received;
+    if (!latencyInterval.isValid()) {
+        latencyInterval.start();
+        return;
+    }
+
+    qint64 elapsed = latencyInterval.elapsed();
+    if (elapsed < FTDI_ADAPTIVE_INTERVAL)
+        return;
+
+    /* 10 bits per character on the line */
+    qint64 rate = latencyBytes * 1000 / elapsed;
+    if (!latencyWritten.loadAcquire() && rate >= FTDIbaudRate / 20 &&
+        FTDIcurrentLatency != FTDIlatencyHigh && applyLatency(FTDIlatencyHigh))
+        latencyRaised++;
+
+    latencyBytes = 0;
+    latencyWritten.storeRelease(0);
+    latencyInterval.start();
+}
+
+/* A write was made, possibly from another thread
+ *
+ * Unbuffered writes block in FT_Write anyway, so the latency
+ * timer goes down right away. A buffered write must not wait
+ * behind the writer thread for ftdiMutex: it is only flagged,
+ * and the latency timer is lowered from the owner's event loop
  */
-FT232::PinoutSignals FT232::pinoutSignals()
+void FT232::noteTransmitted()
 {
-	/* Line status bit field
-	*	B0..B3 - must be 0
-	*	B4 Clear to send (CTS) 0 = inactive; 1 = active
-	*	B5 Data set ready (DTS) 0 = inactive; 1 = active
-	*	B6 Ring indicator (RI) 0 = inactive; 1 = active
-	*	B7 Receive line signal detect (RLSD) 0 = inactive; 1 = active
-	*/
+    if (!writerThread) {
+        adaptLatency(0, true);
+        return;
+    }
+
+    latencyWritten.storeRelease(1);
+    if (latencyLowerPending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "on_FTDIlatencyLower", Qt::QueuedConnection);
+}
+
+/* Lower the latency timer after a buffered write
+ */
+void FT232::on_FTDIlatencyLower()
+{
+    latencyLowerPending.storeRelease(0);
+
+    if (isOpen() && FTDIadaptiveLatency)
+        adaptLatency(0, true);
+}
+
+/* Set how long FT_Read may block waiting for data
+ */
+bool FT232::setReadTimeout(int msecs)
+{
+    if (msecs < 0) {
+        setErrorString(tr("invalid timeout value"));
+        return false;
+    }
+    FTDIreadTimeout = msecs;
+    return applyTimeouts();
+}
+
+/* Set how long FT_Write may block before the write
+ * counts as timed out (TimeoutError)
+ */
+bool FT232::setWriteTimeout(int msecs)
+{
+    if (msecs < 0) {
+        setErrorString(tr("invalid timeout value"));
+        return false;
+    }
+    FTDIwriteTimeout = msecs;
+    return applyTimeouts();
+}
 
+bool FT232::applyTimeouts()
+{
     FT_STATUS ret;
 
-	/* Signals can only be
-	 * read while port is open
-	 */
-	if (!isOpen())
-		return NoSignal;
+    /* If we are not open, just return */
+    if (!isOpen()) return true;
 
-    DWORD modemStatus;
-	/* Read modem status
-	 *
-	 * Use mutex here to avoid reading status
+	/* Use mutex here to avoid changing
      * while the event handler is reading
 	 */
 	ftdiMutex.lock();
-    ret = FT_GetModemStatus(ftdi, &modemStatus);
+    ret = FT_SetTimeouts(ftdi, FTDIreadTimeout, driverWriteTimeout(FTDIwriteTimeout));
 	ftdiMutex.unlock();
 
 	/* If error, setErrorString */
     if (ret != FT_OK) {
-        setErrorString(tr("an error occured while reading the modem status"));
-		return NoSignal;
-	}
-
-    FT232::PinoutSignals retval = NoSignal;
-
+        setErrorString(tr("an error occured while setting the timeouts"));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/* Set the event character. Its arrival makes the chip send
+ * the packet right away, and readyRead() to be emitted
+ * without waiting for the delivery policy
+ */
+bool FT232::setEventCharacter(char c, bool enabled)
+{
+    FTDIeventChar = c;
+    FTDIeventCharEnabled = enabled;
+    return applyChars();
+}
+
+/* Set the character the chip puts in place of
+ * characters received with an error
+ */
+bool FT232::setErrorCharacter(char c, bool enabled)
+{
+    FTDIerrorChar = c;
+    FTDIerrorCharEnabled = enabled;
+    return applyChars();
+}
+
+bool FT232::applyChars()
+{
+    FT_STATUS ret;
+
+    /* If we are not open, just return */
+    if (!isOpen()) return true;
+
+	/* Use mutex here to avoid changing
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    ret = FT_SetChars(ftdi, FTDIeventChar, FTDIeventCharEnabled, FTDIerrorChar, FTDIerrorCharEnabled);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the event character"));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/* Set the USB IN and OUT request sizes, multiples of 64
+ * from 64 to 65536 bytes. Larger IN requests raise the
+ * throughput of Hi-Speed chips at high baud rates
+ */
+bool FT232::setUsbTransferSize(int inSize, int outSize)
+{
+    FT_STATUS ret;
+
+    for (int size : {inSize, outSize}) {
+        if (size < FTDI_USB_TRANSFER_MIN || size > FTDI_USB_TRANSFER_MAX || size % 64) {
+            setErrorString(tr("invalid USB transfer size"));
+            return false;
+        }
+    }
+    FTDIusbInSize = inSize;
+    FTDIusbOutSize = outSize;
+
+    /* If we are not open, just return */
+    if (!isOpen()) return true;
+
+	ftdiMutex.lock();
+    ret = FT_SetUSBParameters(ftdi, inSize, outSize);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the USB transfer size"));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/* Process CPU time in nanoseconds, kernel time included
+ */
+static qint64 processCpuNsecs()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    ULARGE_INTEGER k, u;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+
+    /* 100 ns units */
+    return (k.QuadPart + u.QuadPart) * 100;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (qint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* Transfer size auto-tune
+ *
+ * TX must be looped back to RX. For every IN transfer size
+ * and latency timer value, a test pattern is streamed
+ * through the loopback for msecsPerPoint, measuring
+ * throughput and process CPU time per byte. Empty lists
+ * sweep 4 to 64 KB and 2 to 16 ms.
+ *
+ * The sweep claims the handle like a stream engine: nothing
+ * is received meanwhile. Other I/O waits for the point in
+ * progress only, data written between points goes through
+ * the loopback and is discarded. The settings in use are
+ * restored afterwards.
+ *
+ * Returns the measured points, empty on error
+ */
+QList<FT232::TransferTuning> FT232::autoTuneTransferSize(QList<int> inSizes, QList<int> latencies, int msecsPerPoint)
+{
+    QList<TransferTuning> results;
+
+    if (!isOpen() || (openMode() & QIODevice::ReadWrite) != QIODevice::ReadWrite) {
+        setErrorString(tr("the device is not open for reading and writing"));
+        return results;
+    }
+
+    if (inSizes.isEmpty())
+        inSizes = {4096, 8192, 16384, 32768, 65536};
+    if (latencies.isEmpty())
+        latencies = {2, 4, 8, 16};
+
+    /* Test pattern holding two transfers of the largest size,
+     * not repeating within a transfer
+     */
+    int largest = 0;
+    for (int inSize : inSizes)
+        largest = qMax(largest, inSize);
+
+    QByteArray tx(2 * (qint64)largest, Qt::Uninitialized);
+    QByteArray rx(tx.size(), Qt::Uninitialized);
+    for (qint64 i = 0; i < tx.size(); i++)
+        tx[i] = (char)(i * 7 + (i >> 8));
+
+    /* Keep the UART receive path away from the loopback */
+    FTDIclaimed.storeRelease(1);
+
+    bool ok = true;
+    for (int inSize : inSizes) {
+        for (int latency : latencies) {
+            TransferTuning result;
+
+            /* Use mutex here to keep the event handler and the
+             * writer thread out for this point only
+             */
+            ftdiMutex.lock();
+            ok = tuneRun(inSize, latency, msecsPerPoint, tx, rx, result);
+            ftdiMutex.unlock();
+
+            if (!ok)
+                break;
+            results.append(result);
+
+            /* Let whoever waited for the point have the device */
+            QThread::yieldCurrentThread();
+        }
+        if (!ok)
+            break;
+    }
+
+    /* Restore the settings in use */
+    ftdiMutex.lock();
+    FT_SetUSBParameters(ftdi, FTDIusbInSize > 0 ? FTDIusbInSize : FTDI_USB_TRANSFER_DEFAULT,
+                        FTDIusbOutSize > 0 ? FTDIusbOutSize : FTDI_USB_TRANSFER_DEFAULT);
+    FT_SetLatencyTimer(ftdi, (UCHAR)FTDIcurrentLatency);
+    FT_Purge(ftdi, FT_PURGE_RX | FT_PURGE_TX);
+    ftdiMutex.unlock();
+
+    FTDIclaimed.storeRelease(0);
+
+    if (!ok)
+        results.clear();
+
+    return results;
+}
+
+/* One point of the auto-tune sweep: stream the pattern
+ * over and over for msecs, keeping two transfers in flight
+ * through the loopback, then wait for what is in flight
+ *
+ * Must be called with ftdiMutex held
+ */
+bool FT232::tuneRun(int inSize, int latency, int msecs, const QByteArray &tx, QByteArray &rx,
+                    TransferTuning &result)
+{
+    FT_STATUS ret;
+    DWORD n;
+    qint64 size = tx.size();
+    qint64 written = 0;
+    qint64 received = 0;
+    bool sending = true;
+    bool verified = true;
+
+    ret = FT_SetUSBParameters(ftdi, inSize, FTDIusbOutSize > 0 ? FTDIusbOutSize : FTDI_USB_TRANSFER_DEFAULT);
+    if (ret == FT_OK)
+        ret = FT_SetLatencyTimer(ftdi, (UCHAR)latency);
+    if (ret == FT_OK)
+        ret = FT_Purge(ftdi, FT_PURGE_RX | FT_PURGE_TX);
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the USB transfer size"));
+        return false;
+    }
+
+    QElapsedTimer wall;
+    wall.start();
+    qint64 cpuStart = processCpuNsecs();
+
+    while (true)
+    {
+        if (wall.elapsed() >= msecs)
+            sending = false;
+
+        while (sending && written - received < 2 * inSize) {
+            qint64 offset = written % size;
+            ret = FT_Write(ftdi, (char *)tx.constData() + offset, qMin((qint64)inSize, size - offset), &n);
+            if (ret != FT_OK || n == 0)
+                break;
+            written += n;
+        }
+
+        /* All of it came back, or a write timeout */
+        if (ret != FT_OK || written == received)
+            break;
+
+        /* Blocks until the transfer came back or read timeout */
+        qint64 offset = received % size;
+        ret = FT_Read(ftdi, rx.data() + offset, qMin(qMin((qint64)inSize, written - received), size - offset), &n);
+        if (ret != FT_OK || n == 0)
+            break;
+
+        verified = verified && memcmp(tx.constData() + offset, rx.constData() + offset, n) == 0;
+        received += n;
+    }
+
+    qint64 cpu = processCpuNsecs() - cpuStart;
+    qint64 nsecs = qMax(wall.nsecsElapsed(), (qint64)1);
+
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while streaming through the loopback"));
+        return false;
+    }
+    if (received == 0 || received < written) {
+        setErrorString(tr("no loopback data received"));
+        return false;
+    }
+
+    result.inTransferSize = inSize;
+    result.latencyTimer = latency;
+    result.bytesPerSecond = received * 1e9 / nsecs;
+    result.cpuNsecsPerByte = (double)cpu / received;
+    result.verified = verified;
+
+    return true;
+}
+
+/* FTD2XX data characteristics of a line property
+ */
+static void lineCharacteristics(FT232::LineProperty line, uchar *parity, uchar *sbit)
+{
+	switch (line) {
+    case FT232::SERIAL_8N1: *parity = FT_PARITY_NONE; *sbit = FT_STOP_BITS_1; break;
+    case FT232::SERIAL_8N2: *parity = FT_PARITY_NONE; *sbit = FT_STOP_BITS_2; break;
+    case FT232::SERIAL_8E1: *parity = FT_PARITY_EVEN; *sbit = FT_STOP_BITS_1; break;
+    case FT232::SERIAL_8E2: *parity = FT_PARITY_EVEN; *sbit = FT_STOP_BITS_2; break;
+    case FT232::SERIAL_8O1: *parity = FT_PARITY_ODD; *sbit = FT_STOP_BITS_1; break;
+    case FT232::SERIAL_8O2: *parity = FT_PARITY_ODD; *sbit = FT_STOP_BITS_2; break;
+    case FT232::SERIAL_8M1: *parity = FT_PARITY_MARK; *sbit = FT_STOP_BITS_1; break;
+    case FT232::SERIAL_8M2: *parity = FT_PARITY_MARK; *sbit = FT_STOP_BITS_2; break;
+    case FT232::SERIAL_8S1: *parity = FT_PARITY_SPACE; *sbit = FT_STOP_BITS_1; break;
+    case FT232::SERIAL_8S2: *parity = FT_PARITY_SPACE; *sbit = FT_STOP_BITS_2; break;
+    default: *parity = FT_PARITY_NONE; *sbit = FT_STOP_BITS_1; break;
+	}
+}
+
+/* FTD2XX flow control of a FlowControl value
+ */
+static int flowControlMode(FT232::FlowControl flow)
+{
+	switch (flow) {
+    case FT232::NoFlowControl: return FT_FLOW_NONE;
+    case FT232::HardwareControl: return FT_FLOW_RTS_CTS;
+    case FT232::SoftwareControl: return FT_FLOW_XON_XOFF;
+    case FT232::DTR_DSR_FlowControl: return FT_FLOW_DTR_DSR;
+    default: return FT_FLOW_NONE;
+	}
+}
+
+bool FT232::setLineProperty(LineProperty line)
+{
+    FT_STATUS ret;
+    uchar bits;
+    uchar sbit;
+    uchar parity;
+
+    bits = FT_BITS_8;
+	FTDIlineProperty = line;
+    lineCharacteristics(line, &parity, &sbit);
+
+	/* Change line properties
+	 *
+	 * Use mutex here to avoid changing
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    ret = FT_SetDataCharacteristics(ftdi,bits,sbit,parity);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the data characteristics"));
+		return false;
+	}
+
+	/* Signal line property has changed */
+	emit linePropertyChanged(line);
+
+	return true;
+}
+
+
+bool FT232::setFlowControl(FlowControl flow)
+{
+    FT_STATUS ret;
+	int flowctrl = flowControlMode(flow);
+
+	/* Change flow control
+	 *
+	 * Use mutex here to avoid changing
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    ret = FT_SetFlowControl(ftdi, flowctrl, 0x11, 0x13);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the flow control"));
+        return false;
+    }
+
+	FTDIflowControl = flow;
+	/* Signal flow control has changed */
+	emit flowControlChanged(flow);
+
+	return true;
+}
+
+
+bool FT232::setDataTerminalReady(bool set)
+{
+    FT_STATUS ret;
+
+	/* DTR can only be set while port
+	 * is open
+	 */
+	if (!isOpen())
+		return false;
+
+	/* Set DTR
+	 *
+	 * Use mutex here to avoid changing
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    if(set)
+        ret = FT_SetDtr(ftdi);
+    else
+        ret = FT_ClrDtr(ftdi);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the DTR"));
+        return false;
+    }
+
+	FTDIdtr = set;
+	/* Signal DTR has changed */
+	emit dataTerminalReadyChanged(set);
+
+	return true;
+}
+
+
+bool FT232::setRequestToSend(bool set)
+{
+    FT_STATUS ret;
+
+	/* RTS can only be set while port
+	 * is open
+	 */
+	if (!isOpen())
+		return false;
+
+	/* Held low by backpressure: only remember
+	 * the state, it is applied on release
+	 */
+	if (rtsHeld()) {
+		FTDIrts = set;
+		emit requestToSendChanged(set);
+		return true;
+	}
+
+	/* Set RTS
+	 *
+	 * Use mutex here to avoid changing
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    if(set)
+        ret = FT_SetRts(ftdi);
+    else
+        ret = FT_ClrRts(ftdi);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while setting the RTS"));
+        return false;
+    }
+
+	FTDIrts = set;
+	/* Signal RTS has changed */
+	emit requestToSendChanged(set);
+
+	return true;
+}
+
+
+/* Returns the settings in use, or to be applied at open()
+ */
+FT232Settings FT232::settings() const
+{
+    FT232Settings current;
+
+    current.baudRate = FTDIbaudRate;
+    current.lineProperty = FTDIlineProperty;
+    current.flowControl = FTDIflowControl;
+    current.dataTerminalReady = FTDIdtr;
+    current.requestToSend = FTDIrts;
+    current.latencyTimer = FTDIlatencyTimer;
+    current.readTimeout = FTDIreadTimeout;
+    current.writeTimeout = FTDIwriteTimeout;
+
+    return current;
+}
+
+/* Apply all settings in one transaction
+ *
+ * Everything is set under one lock, and only values that
+ * differ from the current ones cost a USB transfer. Before
+ * open(), the settings are stored and applied by open().
+ * Emits settingsChanged() once if anything changed
+ */
+bool FT232::applySettings(const FT232Settings &settings)
+{
+    FT_STATUS ret = FT_OK;
+    QString error;
+    FT232Settings current = this->settings();
+
+    if (settings.latencyTimer < FTDI_LATENCY_MIN || settings.latencyTimer > FTDI_LATENCY_MAX) {
+        setErrorString(tr("invalid latency timer value"));
+        return false;
+    }
+    if (settings.readTimeout < 0 || settings.writeTimeout < 0) {
+        setErrorString(tr("invalid timeout value"));
+        return false;
+    }
+
+    /* If we are not open, apply all at open() */
+    if (!isOpen()) {
+        FTDIbaudRate = settings.baudRate;
+        FTDIlineProperty = settings.lineProperty;
+        FTDIflowControl = settings.flowControl;
+        FTDIdtr = settings.dataTerminalReady;
+        FTDIrts = settings.requestToSend;
+        FTDIlatencyTimer = settings.latencyTimer;
+        FTDIreadTimeout = settings.readTimeout;
+        FTDIwriteTimeout = settings.writeTimeout;
+        applySettingsAtOpen = true;
+        return true;
+    }
+    applySettingsAtOpen = true;
+
+    if (settings == current)
+        return true;
+
+	/* Use mutex here to avoid changing
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    if (settings.baudRate != current.baudRate) {
+        ret = FT_SetBaudRate(ftdi, settings.baudRate);
+        if (ret == FT_OK)
+            FTDIbaudRate = settings.baudRate;
+        else
+            error = tr("an error occured while setting the baudrate");
+    }
+
+    if (ret == FT_OK)
+        error = writeLineSettings(settings, &current);
+
+    /* Adaptive latency keeps control of the latency timer */
+    if (error.isEmpty() && settings.latencyTimer != current.latencyTimer) {
+        if (!FTDIadaptiveLatency && settings.latencyTimer != FTDIcurrentLatency) {
+            ret = FT_SetLatencyTimer(ftdi, (UCHAR)settings.latencyTimer);
+            if (ret == FT_OK)
+                FTDIcurrentLatency = settings.latencyTimer;
+            else
+                error = tr("an error occured while setting the latency timer");
+        }
+        if (ret == FT_OK)
+            FTDIlatencyTimer = settings.latencyTimer;
+    }
+
+    if (error.isEmpty() && (settings.readTimeout != current.readTimeout ||
+                            settings.writeTimeout != current.writeTimeout)) {
+        ret = FT_SetTimeouts(ftdi, settings.readTimeout, driverWriteTimeout(settings.writeTimeout));
+        if (ret == FT_OK) {
+            FTDIreadTimeout = settings.readTimeout;
+            FTDIwriteTimeout = settings.writeTimeout;
+        } else {
+            error = tr("an error occured while setting the timeouts");
+        }
+    }
+	ftdiMutex.unlock();
+
+    /* Whatever did change is reported */
+    if (this->settings() != current)
+        emit settingsChanged(this->settings());
+
+	/* If error, setErrorString */
+    if (!error.isEmpty()) {
+        setErrorString(error);
+        return false;
+    }
+
+    return true;
+}
+
+/* Set line property, flow control, DTR and RTS, skipping
+ * those equal in current (none without current). Returns
+ * the error message, empty if all went well
+ *
+ * Must be called with ftdiMutex held
+ */
+QString FT232::writeLineSettings(const FT232Settings &settings, const FT232Settings *current)
+{
+    FT_STATUS ret;
+
+    if (!current || settings.lineProperty != current->lineProperty) {
+        uchar sbit;
+        uchar parity;
+
+        lineCharacteristics(settings.lineProperty, &parity, &sbit);
+        ret = FT_SetDataCharacteristics(ftdi, FT_BITS_8, sbit, parity);
+        if (ret != FT_OK)
+            return tr("an error occured while setting the data characteristics");
+        FTDIlineProperty = settings.lineProperty;
+    }
+
+    if (!current || settings.flowControl != current->flowControl) {
+        ret = FT_SetFlowControl(ftdi, flowControlMode(settings.flowControl), 0x11, 0x13);
+        if (ret != FT_OK)
+            return tr("an error occured while setting the flow control");
+        FTDIflowControl = settings.flowControl;
+    }
+
+    if (!current || settings.dataTerminalReady != current->dataTerminalReady) {
+        ret = settings.dataTerminalReady ? FT_SetDtr(ftdi) : FT_ClrDtr(ftdi);
+        if (ret != FT_OK)
+            return tr("an error occured while setting the DTR");
+        FTDIdtr = settings.dataTerminalReady;
+    }
+
+    /* RTS held low by backpressure stays low, the
+     * new state is applied on release
+     */
+    if (!current || settings.requestToSend != current->requestToSend) {
+        FTDIrts = settings.requestToSend;
+        ret = writeRequestToSend(rtsHeld());
+        if (ret != FT_OK)
+            return tr("an error occured while setting the RTS");
+    }
+
+    return QString();
+}
+
+/* Back to UART mode with all settings programmed again,
+ * after a stream engine used another bit mode
+ *
+ * Must be called with ftdiMutex held
+ */
+bool FT232::restoreSettings()
+{
+    FT_STATUS ret;
+
+    ret = FT_SetBitMode(ftdi, 0, FT_BITMODE_RESET);
+    if (ret == FT_OK)
+        ret = FT_SetBaudRate(ftdi, FTDIbaudRate);
+    if (ret == FT_OK)
+        ret = FT_SetLatencyTimer(ftdi, (UCHAR)FTDIcurrentLatency);
+    if (ret == FT_OK)
+        ret = FT_SetTimeouts(ftdi, FTDIreadTimeout, driverWriteTimeout(FTDIwriteTimeout));
+    if (ret == FT_OK)
+        ret = FT_SetUSBParameters(ftdi, FTDIusbInSize > 0 ? FTDIusbInSize : FTDI_USB_TRANSFER_DEFAULT,
+                                  FTDIusbOutSize > 0 ? FTDIusbOutSize : FTDI_USB_TRANSFER_DEFAULT);
+    if (ret == FT_OK)
+        ret = FT_SetChars(ftdi, FTDIeventChar, FTDIeventCharEnabled, FTDIerrorChar, FTDIerrorCharEnabled);
+    if (ret == FT_OK)
+        ret = FT_Purge(ftdi, FT_PURGE_RX | FT_PURGE_TX);
+
+    return ret == FT_OK && writeLineSettings(settings(), nullptr).isEmpty();
+}
+
+/* Parses first byte of modemStatus and returns
+ * active data lines
+ */
+FT232::PinoutSignals FT232::pinoutSignals()
+{
+	/* Line status bit field
+	*	B0..B3 - must be 0
+	*	B4 Clear to send (CTS) 0 = inactive; 1 = active
+	*	B5 Data set ready (DTS) 0 = inactive; 1 = active
+	*	B6 Ring indicator (RI) 0 = inactive; 1 = active
+	*	B7 Receive line signal detect (RLSD) 0 = inactive; 1 = active
+	*/
+
+    FT_STATUS ret;
+
+	/* Signals can only be
+	 * read while port is open
+	 */
+	if (!isOpen())
+		return NoSignal;
+
+    ULONG modemStatus;
+	/* Read modem status
+	 *
+	 * Use mutex here to avoid reading status
+     * while the event handler is reading
+	 */
+	ftdiMutex.lock();
+    ret = FT_GetModemStatus(ftdi, &modemStatus);
+	ftdiMutex.unlock();
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while reading the modem status"));
+		return NoSignal;
+	}
+
+    FT232::PinoutSignals retval = NoSignal;
+
 	if (modemStatus & 0x0080)
 		retval |= ReceivedDataSignal;
 
-	if (modemStatus & 0x0040)
-		retval |= RingIndicatorSignal;
+	if (modemStatus & 0x0040)
+		retval |= RingIndicatorSignal;
+
+	if (modemStatus & 0x0020)
+		retval |= DataSetReadySignal;
+
+	if (modemStatus & 0x0010)
+		retval |= ClearToSendSignal;
+
+    return retval;
+}
+
+void FT232::on_FTDIevent()
+{
+    DWORD EventDWord;
+    DWORD RxBytes;
+    DWORD TxBytes;
+    FT_STATUS ret;
+
+    /* Event thread may queue us again from now on */
+    if (readerThread)
+        readerThread->notifyPending.storeRelease(0);
+
+    /* A stream engine reads the device meanwhile */
+    if (FTDIclaimed.loadAcquire())
+        return;
+
+    /* Read device status
+     *
+     * Use mutex here to avoid reading status
+     * while the event handler is reading
+     */
+    ftdiMutex.lock();
+    ret = FT_GetStatus(ftdi, &RxBytes, &TxBytes, &EventDWord);
+    ftdiMutex.unlock();
+    /* Very serious error, stop everything */
+    if (ret != FT_OK) {
+        /* setErrorString */
+        setErrorString(tr("an error occured while reading the device status"));
+        if (!isOpen())
+            errFlag = NotOpenError;
+        else
+            errFlag = ReadError;
+        emit errorOccurred();
+
+        return;
+    }
+
+    /* Handle every pending event in one pass, both bits are
+     * often set together and the next event may never come.
+     *
+     * If it is a RXCHAR event run the receive handler with the
+     * RxBytes count we already have. Data goes first: a serious
+     * modem error purges the device queue, which would leave
+     * RxBytes stale.
+     * If the event is modem error fire the on_FTDImodemError() function
+     *
+     * Ignores all unknown events
+     */
+    if ((EventDWord & FT_EVENT_RXCHAR) || RxBytes > 0)
+        receive(RxBytes);
+    if (EventDWord & FT_EVENT_MODEM_STATUS)
+        on_FTDImodemError();
+
+}
+
+
+/* Parses second byte of modemStatus and returns
+ * active error flags
+ */
+void FT232::on_FTDImodemError()
+{
+    /* modemStatus Bit field  (*):serious errors
+    * B8	Data Ready (DR)
+    * B9*	Overrun Error (OE)
+    * B10*	Parity Error (PE)
+    * B11*	Framing Error (FE)
+    * B12	Break Interrupt (BI)
+    * B13	Transmitter Holding Register (THRE)
+    * B14	Transmitter Empty (TEMT)
+    * B15*	Error in RCVR FIFO */
+    FT_STATUS ret;
+    ULONG modemStatus;
+
+    /* Get mutex before reading */
+    ftdiMutex.lock();
+    ret = FT_GetModemStatus(ftdi, &modemStatus);
+    ftdiMutex.unlock();
+
+    /* Very serious error, stop everything */
+    if (ret != FT_OK) {
+        /* setErrorString */
+        setErrorString(tr("an error occured while reading the device status"));
+        if (!isOpen())
+            errFlag = NotOpenError;
+        else
+            errFlag = ReadError;
+        emit errorOccurred();
+
+        return;
+    }
+
+    /* Mask out serious errors */
+    if (modemStatus & 0b1000111000000000) {
+        /* Get mutex before flushing buffers */
+        ftdiMutex.lock();
+        FT_Purge(ftdi, FT_PURGE_RX | FT_PURGE_TX);
+        ftdiMutex.unlock();
+
+        return;
+    }
+
+    FT232::PortErrors retval = NoError;
+
+	if (modemStatus & 0x8000)
+		retval |= FIFOError;
+
+	if (modemStatus & 0x1000)
+		retval |= BreakConditionError;
+
+	if (modemStatus & 0x0800)
+		retval |= FramingError;
+
+	if (modemStatus & 0x0400)
+		retval |= ParityError;
+
+	if (modemStatus & 0x0200)
+		retval |= OverrunError;
+
+	errFlag = retval;
+
+	//Modem errors are quite frequent, so not emited
+//	emit errorOccurred();
+}
+
+
+/* Returns the number of bytes that are available for reading.
+ * Subclasses that reimplement this function must call
+ * the base implementation in order to include the size of the buffer of QIODevice
+ *
+ * The receive buffer size is read from its atomic indices,
+ * no lock is taken
+ */
+qint64 FT232::bytesAvailable() const
+{
+	qint64 my_size = FTDIreadBuffer.size();
+	qint64 builtin_size = QIODevice::bytesAvailable();
+
+	return (my_size + builtin_size);
+}
+
+/* Slot version of the receive handler. Asks the
+ * device how many bytes are waiting first
+ */
+void FT232::on_FTDIreceive()
+{
+    DWORD bytesAvailable = 0;
+    FT_STATUS ret;
+
+    if (FTDIclaimed.loadAcquire())
+        return;
+
+    /* Get mutex before reading */
+    ftdiMutex.lock();
+    ret = FT_GetQueueStatus(ftdi,&bytesAvailable);
+    ftdiMutex.unlock();
+
+    if (ret == FT_OK && bytesAvailable > 0)
+        receive(bytesAvailable);
+}
+
+/* Write received data to the end of internal
+ * intermediate buffer
+ *
+ * Keeps reading until the device queue is empty, so bytes
+ * arriving during a read do not wait for the next event.
+ * Each wakeup is bounded by the receive budget; if it runs
+ * out, the rest is picked up from a queued call so other
+ * events get a chance in between
+ */
+void FT232::receive(DWORD rxBytes)
+{
+    DWORD bytesReturned;
+    qint64 received = 0;
+    qint64 stored = 0;
+    bool more = false;
+    FT_STATUS ret = FT_OK;
+    QElapsedTimer elapsed;
+
+    /* Backpressure through the chip: leave data in the device */
+    if (receivePaused())
+        return;
+
+    elapsed.start();
+    while (rxBytes > 0)
+    {
+        /* Do not read past the byte budget */
+        if (FTDIrxBudgetBytes > 0)
+            rxBytes = qMin((qint64)rxBytes, FTDIrxBudgetBytes - received);
+
+        /* Apply the overflow policy, the excess is read
+         * and thrown away so the device does not overrun
+         */
+        DWORD accept = admit(rxBytes);
+        DWORD excess = rxBytes - accept;
+        bytesReturned = 0;
+
+        /* Get mutex before reading, release it between
+         * reads so writers are not locked out
+         */
+        ftdiMutex.lock();
+        if (excess && FTDIoverflowPolicy == DropOldest)
+            ret = discardDevice(excess);
+        if (ret == FT_OK && accept)
+            ret = readDevice(accept, &bytesReturned);
+        if (ret == FT_OK && excess && FTDIoverflowPolicy != DropOldest)
+            ret = discardDevice(excess);
+        /* Look again, bytes keep arriving while we read */
+        if (ret != FT_OK || FT_GetQueueStatus(ftdi, &rxBytes) != FT_OK)
+            rxBytes = 0;
+        ftdiMutex.unlock();
+
+        stored += bytesReturned;
+        received += bytesReturned + excess;
+        if (ret != FT_OK)
+            break;
+
+        /* Buffer got full, stop here */
+        updateThrottle();
+        if (receivePaused())
+            break;
+
+        /* Budget exhausted, continue later */
+        if ((FTDIrxBudgetBytes > 0 && received >= FTDIrxBudgetBytes) ||
+            (FTDIrxBudgetUsecs > 0 && elapsed.nsecsElapsed() / 1000 >= FTDIrxBudgetUsecs)) {
+            more = rxBytes > 0;
+            break;
+        }
+    }
+
+    /* Read OK, emit data */
+    if (stored > 0)
+    {
+        /* Emit signals according to delivery policy */
+        deliver(stored);
+    }
+
+    reportOverflow();
+
+    /* FTDI buffer overflow */
+    if (ret == FT_IO_ERROR) {
+        /* setErrorString */
+        setErrorString(tr("an IO error occured"));
+        if (!isOpen())
+            errFlag = NotOpenError;
+        else
+            errFlag = ReadError;
+        emit errorOccurred();
+
+        return;
+    }
+
+    /* Very serious error, stop thread */
+    if (ret != FT_OK) {
+        /* setErrorString */
+        setErrorString(tr("an error occured while reading bytes from the device"));
+        if (!isOpen())
+            errFlag = NotOpenError;
+        else
+            errFlag = ReadError;
+        emit errorOccurred();
+
+        return;
+    }
+
+    if (more)
+        QMetaObject::invokeMethod(this, "on_FTDIreceive", Qt::QueuedConnection);
+}
+
+/* Read len bytes straight into the free space of the
+ * receive buffer. If it wraps around, the second part
+ * goes to the beginning of the storage. Once the buffer
+ * has grown to the working size, this allocates nothing
+ *
+ * Must be called with ftdiMutex held
+ */
+FT_STATUS FT232::readDevice(DWORD len, DWORD *bytesReturned)
+{
+    DWORD chunkReturned = 0;
+    qint64 contiguous;
+    char *buff;
+    FT_STATUS ret;
+
+    *bytesReturned = 0;
+
+    buff = FTDIreadBuffer.reserve(len, &contiguous);
+    ret = FT_Read(ftdi, buff, contiguous, &chunkReturned);
+    if (ret != FT_OK)
+        return ret;
+    FTDIreadBuffer.commit(chunkReturned);
+    *bytesReturned = chunkReturned;
+
+    if (chunkReturned == (DWORD)contiguous && len > (DWORD)contiguous)
+    {
+        buff = FTDIreadBuffer.reserve(len - contiguous, &contiguous);
+        ret = FT_Read(ftdi, buff, contiguous, &chunkReturned);
+        if (ret != FT_OK)
+            return ret;
+        FTDIreadBuffer.commit(chunkReturned);
+        *bytesReturned += chunkReturned;
+    }
+
+    return FT_OK;
+}
+
+/* Collect the chunks queued by the reader thread
+ * into the internal intermediate buffer
+ */
+void FT232::on_FTDIreaderData()
+{
+    const char *chunk;
+    qint64 len;
+    qint64 received = 0;
+
+    /* Thread stopped meanwhile */
+    if (!readerThread)
+        return;
+
+    /* Clear the flag first, so anything published
+     * from now on wakes us up again
+     */
+    readerThread->notifyPending.storeRelease(0);
+
+    if (readerThread->errorPending.fetchAndStoreOrdered(0)) {
+        /* setErrorString */
+        setErrorString(tr("an error occured while reading bytes from the device"));
+        if (!isOpen())
+            errFlag = NotOpenError;
+        else
+            errFlag = ReadError;
+        emit errorOccurred();
+    }
+
+    if (readerThread->modemPending.fetchAndStoreOrdered(0))
+        on_FTDImodemError();
+
+    /* While paused for backpressure chunks stay in the queue,
+     * the thread stops reading once it is full
+     */
+    while (!receivePaused() && (chunk = readerThread->queue.readSlot(&len)) != nullptr) {
+        /* Apply the overflow policy */
+        qint64 accept = admit(len);
+        if (FTDIoverflowPolicy == DropOldest)
+            FTDIreadBuffer.append(chunk + len - accept, accept);
+        else
+            FTDIreadBuffer.append(chunk, accept);
+        readerThread->queue.release();
+
+        received += accept;
+
+        updateThrottle();
+    }
+
+    /* Read OK, emit data */
+    if (received > 0)
+    {
+        /* Emit signals according to delivery policy */
+        deliver(received);
+    }
+
+    reportOverflow();
+}
+
+/* Set the maximum size of the receive buffer, 0 means
+ * unlimited. Like QSerialPort::setReadBufferSize()
+ */
+void FT232::setReadBufferSize(qint64 size)
+{
+    FTDIreadBufferSize = size;
+    updateThrottle();
+}
+
+/* Set the buffer levels at which backpressure is applied
+ * and released. 0 picks 3/4 and 1/4 of the buffer size
+ */
+void FT232::setReadBufferWatermarks(qint64 high, qint64 low)
+{
+    FTDIhighWatermark = high;
+    FTDIlowWatermark = low;
+    updateThrottle();
+}
+
+qint64 FT232::highWatermark()
+{
+    return FTDIhighWatermark > 0 ? FTDIhighWatermark : FTDIreadBufferSize * 3 / 4;
+}
+
+qint64 FT232::lowWatermark()
+{
+    return FTDIlowWatermark > 0 ? FTDIlowWatermark : FTDIreadBufferSize / 4;
+}
+
+/* Returns true if receiving stopped to let the chip
+ * drive its own flow control line
+ */
+bool FT232::receivePaused()
+{
+    /* A stream engine owns the handle */
+    if (FTDIclaimed.loadAcquire())
+        return true;
+
+    return rxThrottled && (FTDIflowControl == HardwareControl ||
+                           FTDIflowControl == DTR_DSR_FlowControl);
+}
+
+/* Apply the overflow policy to len incoming bytes and
+ * return how many of them can be stored. With DropOldest
+ * buffered data is dropped first and the excess is the
+ * beginning of the incoming data, otherwise it is the end
+ */
+qint64 FT232::admit(qint64 len)
+{
+    if (FTDIreadBufferSize <= 0)
+        return len;
+
+    qint64 room = qMax(FTDIreadBufferSize - FTDIreadBuffer.size(), (qint64)0);
+    if (len <= room)
+        return len;
+
+    if (FTDIoverflowPolicy == DropOldest) {
+        qint64 old = qMin(len - room, FTDIreadBuffer.size());
+        FTDIreadBuffer.consume(old);
+        overflowBytes += old;
+        room += old;
+    }
+
+    qint64 accept = qMin(len, room);
+    overflowBytes += len - accept;
+    if (FTDIoverflowPolicy == OverflowError)
+        overflowPending = true;
+
+    return accept;
+}
+
+/* Read and throw away len bytes from the device
+ *
+ * Must be called with ftdiMutex held
+ */
+FT_STATUS FT232::discardDevice(DWORD len)
+{
+    DWORD bytesReturned;
+    FT_STATUS ret = FT_OK;
+
+    /* Only allocated once something overflows */
+    if (discardBuffer.isEmpty())
+        discardBuffer.resize(FTDI_RX_BUFFER_SIZE);
+
+    while (len > 0 && ret == FT_OK) {
+        ret = FT_Read(ftdi, discardBuffer.data(), qMin(len, (DWORD)discardBuffer.size()), &bytesReturned);
+        if (bytesReturned == 0)
+            break;
+        len -= bytesReturned;
+    }
+
+    return ret;
+}
+
+/* Emit the error of the OverflowError policy
+ */
+void FT232::reportOverflow()
+{
+    if (!overflowPending)
+        return;
+
+    overflowPending = false;
+    setErrorString(tr("the receive buffer is full, data was lost"));
+    errFlag |= ReadBufferOverflowError;
+    emit errorOccurred();
+}
+
+/* Apply backpressure when the receive buffer crosses
+ * the high watermark and release it below the low one
+ */
+void FT232::updateThrottle()
+{
+    qint64 used = FTDIreadBuffer.size();
+
+    if (!rxThrottled && FTDIreadBufferSize > 0 && used >= highWatermark()) {
+        rxThrottled = true;
+        setThrottle(true);
+    } else if (rxThrottled && (FTDIreadBufferSize <= 0 || used <= lowWatermark())) {
+        rxThrottled = false;
+        setThrottle(false);
+    }
+}
+
+/* Tell the remote side to stop or resume sending,
+ * the way the flow control setting allows
+ */
+void FT232::setThrottle(bool throttle)
+{
+    DWORD _bytesWritten;
+    char flowChar;
+
+    if (!isOpen())
+        return;
+
+    switch (FTDIflowControl) {
+    case SoftwareControl:
+        /* Send XOFF/XON, same characters as in setFlowControl() */
+        flowChar = throttle ? 0x13 : 0x11;
+        ftdiMutex.lock();
+        FT_Write(ftdi, &flowChar, 1, &_bytesWritten);
+        ftdiMutex.unlock();
+        break;
+    case NoFlowControl:
+        /* Only drive RTS when asked to, see setRtsBackpressure() */
+        if (FTDIrtsBackpressure)
+            driveRequestToSend(throttle);
+        break;
+    default:
+        /* RTS/CTS and DTR/DSR lines are driven by the chip from
+         * its own FIFO. Receiving is paused meanwhile, so the
+         * FIFO fills up and the chip deasserts the line. On
+         * release, drain what piled up in the device
+         */
+        if (!throttle)
+            QMetaObject::invokeMethod(this, FTDIthreadedReceive ? "on_FTDIreaderData" : "on_FTDIreceive",
+                                      Qt::QueuedConnection);
+        break;
+    }
+}
+
+/* Without flow control, RTS is often the application's
+ * own line (RS-485 direction, target reset), so receive
+ * backpressure leaves it alone unless enabled here. When
+ * enabled, RTS is dropped while throttled and put back to
+ * the state set with setRequestToSend() on release
+ */
+void FT232::setRtsBackpressure(bool enable)
+{
+    bool held = rtsHeld();
+
+    FTDIrtsBackpressure = enable;
 
-	if (modemStatus & 0x0020)
-		retval |= DataSetReadySignal;
+    /* If we are not open, just return */
+    if (!isOpen()) return;
 
-	if (modemStatus & 0x0010)
-		retval |= ClearToSendSignal;
+    if (rtsHeld() != held)
+        driveRequestToSend(rtsHeld());
+}
 
-    return retval;
+/* True while backpressure keeps RTS low
+ */
+bool FT232::rtsHeld() const
+{
+    return rxThrottled && FTDIrtsBackpressure && FTDIflowControl == NoFlowControl;
 }
 
-void FT232::on_FTDIevent()
+/* Drive the RTS line for backpressure: low while held,
+ * otherwise as set with setRequestToSend(). The RTS state
+ * of the application and its signal are left alone
+ */
+bool FT232::driveRequestToSend(bool hold)
 {
-    DWORD EventDWord;
-    DWORD RxBytes;
-    DWORD TxBytes;
     FT_STATUS ret;
 
-    /* Read device status
-     *
-     * Use mutex here to avoid reading status
+	/* Use mutex here to avoid changing
      * while the event handler is reading
-     */
+	 */
     ftdiMutex.lock();
-    ret = FT_GetStatus(ftdi, &RxBytes, &TxBytes, &EventDWord);
+    ret = writeRequestToSend(hold);
     ftdiMutex.unlock();
-    /* Very serious error, stop everything */
-    if (ret != FT_OK) {
-        /* setErrorString */
-        setErrorString(tr("an error occured while reading the device status"));
-        if (!isOpen())
-            errFlag = NotOpenError;
-        else
-            errFlag = ReadError;
-        emit errorOccurred();
 
-        return;
-    }
+    return ret == FT_OK;
+}
 
-    /* If the event is modem error fire the on_FTDImodemError() function
-     * otherwise if it is a RXCHAR event fire the on_FTDIreceive() function
-     *
-     * Ignores all unknown events
-     */
-    if(EventDWord & FT_EVENT_MODEM_STATUS)
-        on_FTDImodemError();
-    else if (EventDWord & FT_EVENT_RXCHAR)
-        on_FTDIreceive();
+/* Set the RTS line: low while held, otherwise FTDIrts
+ *
+ * Must be called with ftdiMutex held
+ */
+FT_STATUS FT232::writeRequestToSend(bool hold)
+{
+    if (hold || !FTDIrts)
+        return FT_ClrRts(ftdi);
 
+    return FT_SetRts(ftdi);
 }
 
+/* Set how readyRead() is emitted
+ *
+ * ImmediateReadyRead emits for every received chunk.
+ * CoalescedReadyRead emits once thresholdBytes are waiting
+ * or delayUsecs after the first undelivered byte, whichever
+ * comes first. The delay is also checked on every received
+ * chunk, the timer only covers a quiet line and has
+ * millisecond resolution
+ */
+void FT232::setReadyReadPolicy(ReadyReadPolicy policy, qint64 thresholdBytes, int delayUsecs)
+{
+    FTDIreadyReadPolicy = policy;
+    FTDIreadyReadThreshold = thresholdBytes;
+    FTDIreadyReadDelay = delayUsecs;
 
-/* Parses second byte of modemStatus and returns
- * active error flags
+    /* Deliver anything held back under the old policy */
+    if (undeliveredBytes > 0)
+        emitReadyRead();
+}
+
+/* Reset readyRead() statistics
  */
-void FT232::on_FTDImodemError()
+void FT232::resetReadyReadCounters()
 {
-    /* modemStatus Bit field  (*):serious errors
-    * B8	Data Ready (DR)
-    * B9*	Overrun Error (OE)
-    * B10*	Parity Error (PE)
-    * B11*	Framing Error (FE)
-    * B12	Break Interrupt (BI)
-    * B13	Transmitter Holding Register (THRE)
-    * B14	Transmitter Empty (TEMT)
-    * B15*	Error in RCVR FIFO */
-    FT_STATUS ret;
-    DWORD modemStatus;
+    readyReadCount = 0;
+    receivedChunkCount = 0;
+}
 
-    /* Get mutex before reading */
-    ftdiMutex.lock();
-    ret = FT_GetModemStatus(ftdi, &modemStatus);
-    ftdiMutex.unlock();
+/* Account a received chunk and emit readyRead()
+ * if the delivery policy says so
+ */
+void FT232::deliver(qint64 received)
+{
+    if (FTDIadaptiveLatency)
+        adaptLatency(received, false);
 
-    /* Very serious error, stop everything */
-    if (ret != FT_OK) {
-        /* setErrorString */
-        setErrorString(tr("an error occured while reading the device status"));
-        if (!isOpen())
-            errFlag = NotOpenError;
-        else
-            errFlag = ReadError;
-        emit errorOccurred();
+    receivedChunkCount++;
+    undeliveredBytes += received;
 
+    if (FTDIreadyReadPolicy == ImmediateReadyRead ||
+        undeliveredBytes >= FTDIreadyReadThreshold) {
+        emitReadyRead();
         return;
     }
 
-    /* Mask out serious errors */
-    if (modemStatus & 0b1000111000000000) {
-        /* Get mutex before flushing buffers */
-        ftdiMutex.lock();
-        FT_Purge(ftdi, FT_PURGE_RX | FT_PURGE_TX);
-        ftdiMutex.unlock();
+    /* A frame is complete, do not hold it back */
+    if (FTDIeventCharEnabled && endsFrame(received)) {
+        emitReadyRead();
+        return;
+    }
 
+    /* First undelivered byte, start the clock */
+    if (!readyReadTimer.isActive()) {
+        undeliveredSince.start();
+        readyReadTimer.start((FTDIreadyReadDelay + 999) / 1000);
         return;
     }
 
-    FT232::PortErrors retval = NoError;
+    if (undeliveredSince.nsecsElapsed() / 1000 >= FTDIreadyReadDelay)
+        emitReadyRead();
+}
 
-	if (modemStatus & 0x8000)
-		retval |= FIFOError;
+/* Returns true if the event character is among the
+ * last received bytes of the buffer
+ */
+bool FT232::endsFrame(qint64 received) const
+{
+    ReadSpans spans = readSpans();
+    qint64 skip = qMax(spans.size() - received, (qint64)0);
 
-	if (modemStatus & 0x1000)
-		retval |= BreakConditionError;
+    for (const ReadSpan &span : {spans.first, spans.second}) {
+        if (skip >= span.size) {
+            skip -= span.size;
+            continue;
+        }
+        if (memchr(span.data + skip, FTDIeventChar, span.size - skip))
+            return true;
+        skip = 0;
+    }
 
-	if (modemStatus & 0x0800)
-		retval |= FramingError;
+    return false;
+}
 
-	if (modemStatus & 0x0400)
-		retval |= ParityError;
+/* Delay of the first undelivered byte expired
+ */
+void FT232::on_FTDIdeliveryTimeout()
+{
+    if (undeliveredBytes > 0)
+        emitReadyRead();
+}
 
-	if (modemStatus & 0x0200)
-		retval |= OverrunError;
+void FT232::emitReadyRead()
+{
+    readyReadTimer.stop();
+    undeliveredBytes = 0;
+    readyReadCount++;
 
-	errFlag = retval;
+    /* Emit signals */
+    emit readyRead();
+    emit QIODevice::readyRead();
+}
 
-	//Modem errors are quite frequent, so not emited
-//	emit errorOccurred();
+/* Merge writes made within windowUsecs into one transfer.
+ * Only used in buffered write mode
+ */
+void FT232::setWriteCoalescing(bool enable, int windowUsecs)
+{
+    if (writerThread)
+        writerThread->mutex.lock();
+
+    FTDIwriteCoalescing = enable;
+    FTDIcoalescingWindow = windowUsecs;
+
+    if (writerThread) {
+        writerThread->queueCondition.wakeOne();
+        writerThread->mutex.unlock();
+    }
 }
 
+/* Pace transmission to bytesPerSecond, in bursts of at
+ * most burstBytes. 0 bytesPerSecond disables pacing.
+ * Only used in buffered write mode
+ */
+void FT232::setTransmitPacing(qint64 bytesPerSecond, qint64 burstBytes)
+{
+    if (writerThread)
+        writerThread->mutex.lock();
+
+    FTDIpacingRate = bytesPerSecond;
+    FTDIpacingBurst = burstBytes;
 
-/* Returns the number of bytes that are available for reading.
- * Subclasses that reimplement this function must call
- * the base implementation in order to include the size of the buffer of QIODevice
+    if (writerThread) {
+        writerThread->queueCondition.wakeOne();
+        writerThread->mutex.unlock();
+    }
+}
+
+/* Send coalesced writes right away instead of waiting
+ * for the window. Returns true if anything was pending
  */
-qint64 FT232::bytesAvailable() const
+bool FT232::flush()
 {
-	qint64 my_size = FTDIreadBuffer.size();
-	qint64 builtin_size = QIODevice::bytesAvailable();
+    if (!writerThread)
+        return false;
 
-	return (my_size + builtin_size);
+    writerThread->mutex.lock();
+    bool pending = writerThread->pendingBytes.loadAcquire() > 0;
+    writerThread->flushRequested = pending;
+    writerThread->queueCondition.wakeOne();
+    writerThread->mutex.unlock();
+
+    return pending;
 }
 
-/* Write received data to the end of internal
- * intermediate buffer
+/* Returns the number of bytes queued for writing
+ * and not written yet. Always 0 without buffered write
  */
-void FT232::on_FTDIreceive()
+qint64 FT232::bytesToWrite() const
 {
-    DWORD bytesReturned = 0;
-    DWORD bytesAvailable = 0;
-    char *buff;
-    FT_STATUS ret;
+    qint64 pending = writerThread ? writerThread->pendingBytes.loadAcquire() : 0;
 
-    /* Get mutex before reading */
-    ftdiMutex.lock();
-    ret = FT_GetQueueStatus(ftdi,&bytesAvailable);
-    if(bytesAvailable > 0)
-    {
-        /* If any bytes are available, create accordingly a buffer and read them all */
-        buff = new char [bytesAvailable];
-        ret = FT_Read(ftdi, buff, bytesAvailable, &bytesReturned);
-    }
-    ftdiMutex.unlock();
+    return pending + QIODevice::bytesToWrite();
+}
 
-    /* FTDI buffer overflow */
-    if (bytesAvailable > 0 && ret == FT_IO_ERROR) {
+/* Writer thread made progress: emit bytesWritten()
+ * and report write errors
+ */
+void FT232::on_FTDIwriterProgress()
+{
+    /* Thread stopped meanwhile */
+    if (!writerThread)
+        return;
+
+    /* Clear the flag first, so anything written
+     * from now on wakes us up again
+     */
+    writerThread->notifyPending.storeRelease(0);
+
+    if (writerThread->errorPending.fetchAndStoreOrdered(0)) {
         /* setErrorString */
-        setErrorString(tr("an IO error occured"));
+        setErrorString(tr("an error occured while writing to the port"));
         if (!isOpen())
             errFlag = NotOpenError;
         else
-            errFlag = ReadError;
+            errFlag = WriteError;
         emit errorOccurred();
+    }
 
-        return;
+    if (writerThread->timeoutPending.fetchAndStoreOrdered(0))
+        reportWriteTimeout();
+
+    qint64 written = writerThread->unreportedBytes.fetchAndStoreOrdered(0);
+    if (written > 0)
+        emit bytesWritten(written);
+}
+
+/* A write did not complete within the write timeout.
+ * Reported as TimeoutError, so the caller can retry
+ */
+void FT232::reportWriteTimeout()
+{
+    setErrorString(tr("Write timeout"));
+    if (!isOpen())
+        errFlag = NotOpenError;
+    else
+        errFlag = TimeoutError;
+    emit errorOccurred();
+}
+
+/* Blocks until some queued data was written or
+ * msecs passed. Like QSerialPort, returns true
+ * if bytesWritten() was emitted
+ */
+bool FT232::waitForBytesWritten(int msecs)
+{
+    if (!isOpen() || !writerThread)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    writerThread->mutex.lock();
+    if (writerThread->pendingBytes.loadAcquire() == 0) {
+        writerThread->mutex.unlock();
+        return false;
     }
 
-    /* Very serious error, stop thread */
-    if (bytesAvailable > 0 && ret != FT_OK) {
-        /* setErrorString */
-        setErrorString(tr("an error occured while reading bytes from the device"));
-        if (!isOpen())
-            errFlag = NotOpenError;
-        else
-            errFlag = ReadError;
-        emit errorOccurred();
+    quint64 start = writerThread->writtenTotal;
+    writerThread->writeFailed = false;
+    while (writerThread->writtenTotal == start && !writerThread->writeFailed) {
+        if (msecs < 0) {
+            writerThread->writtenCondition.wait(&writerThread->mutex);
+            continue;
+        }
 
-        return;
+        qint64 remaining = msecs - timer.elapsed();
+        if (remaining <= 0 || !writerThread->writtenCondition.wait(&writerThread->mutex, remaining))
+            break;
     }
+    bool written = writerThread->writtenTotal != start;
+    bool failed = writerThread->writeFailed;
+    writerThread->mutex.unlock();
 
-    /* Read OK, emit data */
-    if (bytesAvailable > 0)
-    {
-        QByteArray data = QByteArray(buff,bytesReturned);
-        /* Append new data */
-        FTDIreadBuffer.append(data);
+    /* Emit what is pending right away, errors included */
+    on_FTDIwriterProgress();
 
-        /* Delete the buffer */
-        delete buff;
-        /* Release n bytes */
-        sem.release(data.size());
+    if (!written && !failed)
+        setErrorString(tr("Write timeout"));
 
-        /* Emit signals */
-        emit readyRead();
-        emit QIODevice::readyRead();
-    }
+    return written;
 }
 
 /* Timeout blocking function that waits
@@ -774,3 +3220,195 @@ QList<FT232Info> FT232Info::availablePorts(int VID, int PID)
 
 	return list;
 }
+
+
+/* Ring buffer constructor
+ *
+ * Capacity is rounded up to the next power of two
+ * so indices can be wrapped with a simple mask
+ */
+FT232RingBuffer::FT232RingBuffer(qint64 initialCapacity)
+    : head(0), tail(0)
+{
+    qint64 cap = 1;
+    while (cap < initialCapacity)
+        cap <<= 1;
+    buffer = QByteArray(cap, Qt::Uninitialized);
+}
+
+/* Number of buffered bytes. head is loaded first: tail only
+ * grows and stays ahead of any head loaded before it, so the
+ * result is never negative, whatever the other side does
+ */
+qint64 FT232RingBuffer::size() const
+{
+    quint64 h = head.loadAcquire();
+    quint64 t = tail.loadAcquire();
+
+    return qint64(t - h);
+}
+
+/* Append len bytes at the tail, doubling the storage
+ * when they do not fit anymore
+ */
+void FT232RingBuffer::append(const char *data, qint64 len)
+{
+    if (len <= 0)
+        return;
+
+    if (size() + len > capacity())
+        grow(size() + len);
+
+    quint64 t = tail.loadAcquire();
+    copyIn(buffer.data(), capacity(), t, data, len);
+    tail.storeRelease(t + len);
+}
+
+/* Copy up to maxSize bytes from the head and
+ * drop them from the buffer
+ */
+qint64 FT232RingBuffer::read(char *data, qint64 maxSize)
+{
+    const char *first, *second;
+    qint64 firstLen, secondLen;
+
+    qint64 n = peek(maxSize, &first, &firstLen, &second, &secondLen);
+    if (n <= 0)
+        return 0;
+
+    memcpy(data, first, firstLen);
+    memcpy(data + firstLen, second, secondLen);
+    head.storeRelease(head.loadAcquire() + n);
+
+    return n;
+}
+
+/* Make sure len bytes fit after the tail and return
+ * a pointer to it. Only the first *contiguous bytes are
+ * in one piece, the rest wraps to the start of storage
+ */
+char *FT232RingBuffer::reserve(qint64 len, qint64 *contiguous)
+{
+    if (size() + len > capacity())
+        grow(size() + len);
+
+    qint64 cap = capacity();
+    qint64 pos = tail.loadAcquire() & (cap - 1);
+    *contiguous = qMin(len, cap - pos);
+
+    return buffer.data() + pos;
+}
+
+/* Point first/second at up to maxSize bytes from the head.
+ * Returns the total number of bytes
+ */
+qint64 FT232RingBuffer::peek(qint64 maxSize, const char **first, qint64 *firstLen,
+                             const char **second, qint64 *secondLen) const
+{
+    qint64 n = qMax(qMin(maxSize, size()), (qint64)0);
+    qint64 cap = capacity();
+    qint64 pos = head.loadAcquire() & (cap - 1);
+    const char *buf = buffer.constData();
+
+    *firstLen = qMin(n, cap - pos);
+    *first = buf + pos;
+    *secondLen = n - *firstLen;
+    *second = buf;
+
+    return n;
+}
+
+/* Copy len bytes to the storage position of index,
+ * wrapping around at the end of storage
+ */
+void FT232RingBuffer::copyIn(char *buf, qint64 cap, quint64 index, const char *data, qint64 len)
+{
+    qint64 pos = index & (cap - 1);
+    qint64 first = qMin(len, cap - pos);
+
+    memcpy(buf + pos, data, first);
+    memcpy(buf, data + first, len - first);
+}
+
+/* Reallocate storage to the next power of two able to
+ * hold required bytes. Data is copied to the positions of
+ * the same indices in the new storage, so head and tail
+ * never move and size() stays valid for other threads
+ */
+void FT232RingBuffer::grow(qint64 required)
+{
+    const char *first, *second;
+    qint64 firstLen, secondLen;
+    quint64 h = head.loadAcquire();
+
+    qint64 newCap = capacity();
+    while (newCap < required)
+        newCap <<= 1;
+
+    QByteArray newBuffer(newCap, Qt::Uninitialized);
+    peek(size(), &first, &firstLen, &second, &secondLen);
+    copyIn(newBuffer.data(), newCap, h, first, firstLen);
+    copyIn(newBuffer.data(), newCap, h + firstLen, second, secondLen);
+
+    buffer.swap(newBuffer);
+}
+
+
+/* Chunk queue constructor
+ *
+ * slotCount is rounded up to the next power of two
+ */
+FT232ChunkQueue::FT232ChunkQueue(int slotCount, qint64 chunkSize)
+    : chunk(chunkSize), count(1)
+{
+    while (count < (quint32)slotCount)
+        count <<= 1;
+
+    storage = QByteArray(count * chunk, Qt::Uninitialized);
+    lengths.resize(count);
+    base = storage.data();
+    lens = lengths.data();
+}
+
+/* Returns the next free chunk or nullptr
+ * if the consumer has not released any
+ */
+char *FT232ChunkQueue::writeSlot()
+{
+    quint32 t = tail.loadAcquire();
+    if (t - head.loadAcquire() == count)
+        return nullptr;
+
+    return base + (t & (count - 1)) * chunk;
+}
+
+/* Make the chunk returned by writeSlot()
+ * visible to the consumer
+ */
+void FT232ChunkQueue::publish(qint64 len)
+{
+    quint32 t = tail.loadAcquire();
+    lens[t & (count - 1)] = len;
+    tail.storeRelease(t + 1);
+}
+
+/* Returns the oldest published chunk or
+ * nullptr if the queue is empty
+ */
+const char *FT232ChunkQueue::readSlot(qint64 *len)
+{
+    quint32 h = head.loadAcquire();
+    if (h == tail.loadAcquire())
+        return nullptr;
+
+    *len = lens[h & (count - 1)];
+    return base + (h & (count - 1)) * chunk;
+}
+
+/* Give the chunk returned by readSlot()
+ * back to the producer
+ */
+void FT232ChunkQueue::release()
+{
+    head.storeRelease(head.loadAcquire() + 1);
+}
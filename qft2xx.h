@@ -1,8 +1,8 @@
 #ifndef QFT2XX_H
 #define QFT2XX_H
 
-#ifndef _WIN32
-#error This class only supports Windows-based operating systems
+#if !defined(_WIN32) && !defined(__linux__)
+#error This class only supports Windows and Linux based operating systems
 #endif
 
 #include <QIODevice>
@@ -10,26 +10,184 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QTimer>
-#include <QSemaphore>
 #include <QPointer>
 #include <QList>
+#include <QVector>
 #include <QEventLoop>
 #include <QDebug>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#ifdef _WIN32
 #include <QWinEventNotifier>
 
 /* Although ftd2xx.h now includes windows.h automatically,
  * some older versions might not. Better safe than sorry.
  */
 #include <windows.h>
+#else
+/* libftd2xx signals events through a pthread
+ * condition (EVENT_HANDLE)
+ */
+#include <pthread.h>
+#include <time.h>
+#endif
 #include "ftd2xx.h"
 
 /* Latency timer value */
 static constexpr uint16_t	FTDI_LATENCY        =	3;
+/* Latency timer range, and the value adaptive
+ * latency uses while streaming
+ */
+static constexpr int FTDI_LATENCY_MIN           =   2;
+static constexpr int FTDI_LATENCY_MAX           =   255;
+static constexpr int FTDI_LATENCY_STREAMING     =   16;
+/* Interval of adaptive latency traffic measurement (ms) */
+static constexpr int FTDI_ADAPTIVE_INTERVAL     =   100;
+/* Default FTD2XX read and write timeouts (ms) */
+static constexpr int FTDI_READ_TIMEOUT          =   5000;
+static constexpr int FTDI_WRITE_TIMEOUT         =   2000;
+/* FT_Write timeout of the writer thread (ms): it writes in
+ * slices this long, so ftdiMutex is never held for longer,
+ * and counts the write timeout itself
+ */
+static constexpr int FTDI_WRITE_SLICE_TIMEOUT   =   20;
+/* USB transfer size range and driver default, sizes
+ * are multiples of 64 bytes
+ */
+static constexpr int FTDI_USB_TRANSFER_MIN      =   64;
+static constexpr int FTDI_USB_TRANSFER_MAX      =   65536;
+static constexpr int FTDI_USB_TRANSFER_DEFAULT  =   4096;
+/* Streaming time of each autoTuneTransferSize() point (ms) */
+static constexpr int FTDI_TUNE_POINT_MSECS      =   200;
 /* FTDI fixed port name */
 static constexpr const char *FTDI_NAME          =	"FTDI";
 /* Default FTDI port parameters */
 static constexpr int FTDI_VID					=	0x0403;
 static constexpr int FTDI_PID					=	0x6001;
+/* Initial size of the receive ring buffer (power of two) */
+static constexpr qint64 FTDI_RX_BUFFER_SIZE     =   4096;
+/* Reader thread queue: number of chunks (power of two) and chunk size */
+static constexpr int FTDI_READER_CHUNKS         =   32;
+static constexpr qint64 FTDI_READER_CHUNK_SIZE  =   16384;
+/* Default receive budget per wakeup, in bytes and microseconds */
+static constexpr qint64 FTDI_RX_BUDGET_BYTES    =   262144;
+static constexpr int FTDI_RX_BUDGET_USECS       =   5000;
+/* Default write coalescing window in microseconds, and
+ * the size of a coalesced transfer in USB packets
+ */
+static constexpr int FTDI_COALESCING_WINDOW     =   500;
+static constexpr int FTDI_COALESCING_PACKETS    =   64;
+/* Tail of a transmit pacing wait that is spun instead of
+ * slept, to absorb the sleep overshoot (us)
+ */
+static constexpr int FTDI_PACING_SPIN_USECS     =   50;
+
+/* Transmit priority lanes, and buckets of
+ * their queueing delay histograms (log2 of us)
+ */
+static constexpr int FTDI_WRITE_LANES           =   2;
+static constexpr int FTDI_DELAY_BUCKETS         =   24;
+/* Event wait timeout in ms. Linux conditions are not latched,
+ * so the device is also checked when the wait times out
+ */
+#ifdef _WIN32
+static constexpr int FTDI_EVENT_TIMEOUT         =   100;
+#else
+static constexpr int FTDI_EVENT_TIMEOUT         =   10;
+#endif
+
+/* Receive ring buffer
+ *
+ * Power-of-two sized byte queue used as the intermediate
+ * receive buffer. Appending is amortized O(1) (storage is
+ * doubled when full) and consuming from the front is O(1),
+ * so draining a large backlog in small pieces never moves
+ * the remaining data around.
+ *
+ * Head and tail are free running atomic indices: the producer
+ * publishes with tail, the consumer with head, so size() is
+ * wait-free and can be called from any thread. Storage only
+ * grows on the producer side, which is why producer and
+ * consumer must run in the same thread (the reader thread
+ * hands its data over through FT232ChunkQueue instead).
+ */
+class FT232RingBuffer
+{
+public:
+    FT232RingBuffer(qint64 initialCapacity = FTDI_RX_BUFFER_SIZE);
+    qint64 size() const;
+    qint64 capacity() const {return buffer.size();}
+    bool isEmpty() const {return size() == 0;}
+    void clear() {head.storeRelease(tail.loadAcquire());}
+
+    void append(const char *data, qint64 len);
+    qint64 read(char *data, qint64 maxSize);
+
+    /* In place writing: reserve() makes room for len bytes
+     * and returns the tail, with the contiguous part of it
+     * in *contiguous. Bytes written there become readable
+     * after commit()
+     */
+    char *reserve(qint64 len, qint64 *contiguous);
+    void commit(qint64 n) {tail.storeRelease(tail.loadAcquire() + n);}
+
+    /* In place reading: peek() returns up to maxSize bytes
+     * from the head as one or two contiguous pieces (the
+     * second one is empty unless the data wraps around),
+     * consume() drops n bytes from the head
+     */
+    qint64 peek(qint64 maxSize, const char **first, qint64 *firstLen,
+                const char **second, qint64 *secondLen) const;
+    void consume(qint64 n) {head.storeRelease(head.loadAcquire() + qMax(qMin(n, size()), (qint64)0));}
+
+private:
+    void grow(qint64 required);
+    static void copyIn(char *buf, qint64 cap, quint64 index, const char *data, qint64 len);
+
+    QByteArray buffer;
+    /* Free running indices, wrapped with (capacity() - 1) */
+    QAtomicInteger<quint64> head;
+    QAtomicInteger<quint64> tail;
+};
+
+/* Chunk queue
+ *
+ * Lock-free single-producer/single-consumer queue of fixed
+ * size chunks, all allocated up front. The producer fills
+ * writeSlot() and publish()es it, the consumer gets the
+ * oldest chunk with readSlot() and hands it back with
+ * release(). Neither side ever blocks: a full queue just
+ * returns no slot.
+ */
+class FT232ChunkQueue
+{
+public:
+    FT232ChunkQueue(int slotCount, qint64 chunkSize);
+    qint64 chunkSize() const {return chunk;}
+
+    /* Producer side */
+    char *writeSlot();
+    void publish(qint64 len);
+
+    /* Consumer side */
+    const char *readSlot(qint64 *len);
+    void release();
+
+private:
+    QByteArray storage;
+    QVector<qint64> lengths;
+    char *base;
+    qint64 *lens;
+    qint64 chunk;
+    quint32 count;
+    QAtomicInteger<quint32> head;
+    QAtomicInteger<quint32> tail;
+};
+
+class FT232ReaderThread;
+class FT232WriterThread;
+struct FT232Settings;
 
 /* Main FT232 class
  *
@@ -44,7 +202,8 @@ static constexpr int FTDI_PID					=	0x6001;
  * on_FTDIevent(): slot for receiving events
  *
  * When data is received, it will be stored on an internal
- * buffer. readyRead() signal will be emitted.
+ * buffer. readyRead() signal will be emitted, for every chunk
+ * or coalesced according to setReadyReadPolicy().
  *
  * QIODevice::read() function call will read from this buffer,
  * so call is non-blocking.
@@ -52,9 +211,63 @@ static constexpr int FTDI_PID					=	0x6001;
  * If need a blocking call, waitForReadyRead() is implemented
  * and will return true if new data is available.
  *
+ * Writing blocks in FT_Write by default. With
+ * setBufferedWrite(true) called before open(), write() only
+ * queues the data for a writer thread; bytesToWrite(),
+ * bytesWritten() and waitForBytesWritten() then work like
+ * in QSerialPort. setWriteCoalescing() additionally merges
+ * small writes made within a short window (or up to flush())
+ * into one USB transfer, and setTransmitPacing() limits the
+ * transmit rate with a token bucket for receivers that
+ * overrun on full speed bursts. writeWithPriority() queues
+ * urgent frames ahead of bulk data already queued, from the
+ * end of the write in progress (a large one is not cut).
+ *
+ * The latency timer (FTDI_LATENCY by default) is set with
+ * setLatencyTimer(). setAdaptiveLatency() instead keeps it
+ * low while the traffic is interactive and raises it during
+ * sustained streaming, where fuller USB packets mean fewer
+ * wakeups.
+ *
+ * With setEventCharacter(), the chip sends its packet as
+ * soon as the event character (e.g. '\n') arrives instead of
+ * waiting for the latency timer, and readyRead() is emitted
+ * right away whatever the delivery policy: frames arrive
+ * with low latency while a high latency timer keeps bulk
+ * transfers efficient.
+ *
+ * applySettings() changes baud rate, line property, flow
+ * control, DTR/RTS, latency timer and timeouts together,
+ * with no window of mixed settings; called before open(),
+ * they are all applied when the port opens.
+ *
+ * setUsbTransferSize() replaces the driver's 4 KB default
+ * USB request size; autoTuneTransferSize() measures sizes
+ * and latency timer values over a loopback to choose one.
+ *
  * Check bytesAvailable() if need to know how many bytes are
  * stored on buffer.
  *
+ * The buffer is unlimited by default. setReadBufferSize()
+ * bounds it: crossing the high watermark asks the remote
+ * side to stop (XOFF, or letting the chip's own flow control
+ * kick in) and the low watermark resumes it. Without flow
+ * control, RTS is only dropped if setRtsBackpressure(true)
+ * was called. What still does not fit is handled by the
+ * overflow policy.
+ *
+ * Parsers can also work on the buffer in place: readSpans()
+ * returns views of the stored data and consume() drops what
+ * was used, without copying it through QIODevice::read().
+ *
+ * By default the device is serviced from the owner's event
+ * loop (on Linux a small thread waits for the FTD2XX event
+ * and queues on_FTDIevent()). With setThreadedReceive(true)
+ * called before open(),
+ * a dedicated reader thread drains the device instead and
+ * only hands the data over to the owner thread, so a busy
+ * event loop no longer lets the FTDI FIFO overrun.
+ *
  */
 class FT232 : public QIODevice
 {
@@ -62,7 +275,8 @@ class FT232 : public QIODevice
 
 public:
 	enum PortError {NoError = 0x00, NotOpenError = 0x01, OverrunError = 0x02, ParityError = 0x04,
-					FramingError = 0x10, BreakConditionError = 0x20, FIFOError = 0x40, ReadError = 0x80};
+					FramingError = 0x10, BreakConditionError = 0x20, FIFOError = 0x40, ReadError = 0x80,
+                    ReadBufferOverflowError = 0x100, WriteError = 0x200, TimeoutError = 0x400};
 	Q_FLAG(PortError)
 	Q_DECLARE_FLAGS(PortErrors, PortError)
 
@@ -74,23 +288,90 @@ public:
 	enum FlowControl {NoFlowControl, HardwareControl, SoftwareControl, DTR_DSR_FlowControl};
 	Q_ENUM(FlowControl)
 
+    enum ReadyReadPolicy {ImmediateReadyRead, CoalescedReadyRead};
+    Q_ENUM(ReadyReadPolicy)
+
+    enum OverflowPolicy {DropOldest, DropNewest, OverflowError};
+    Q_ENUM(OverflowPolicy)
+
+    enum WritePriority {NormalPriority, HighPriority};
+    Q_ENUM(WritePriority)
+
 	enum PinoutSignal {NoSignal = 0x00, ReceivedDataSignal = 0x02, DataSetReadySignal = 0x10,
 					   RingIndicatorSignal = 0x20, ClearToSendSignal = 0x80};
 	Q_FLAG(PinoutSignal)
 	Q_DECLARE_FLAGS(PinoutSignals, PinoutSignal)
 
+    /* Contiguous view of received data */
+    struct ReadSpan {
+        const char *data;
+        qint64 size;
+    };
+    /* Received data as one or two views, second is
+     * empty unless the data wraps around in the buffer
+     */
+    struct ReadSpans {
+        ReadSpan first;
+        ReadSpan second;
+        qint64 size() const {return first.size + second.size;}
+    };
+    /* One point of the autoTuneTransferSize() sweep */
+    struct TransferTuning {
+        int inTransferSize;
+        int latencyTimer;
+        double bytesPerSecond;
+        double cpuNsecsPerByte;
+        bool verified;
+    };
+
     FT232(QObject * parent = nullptr);
     virtual ~FT232();
 	bool open(QIODevice::OpenMode mode = QIODevice::ReadWrite);
 	bool isSequential() const {return true;}
 	qint64 bytesAvailable() const;
+    bool canReadLine() const;
 	bool waitForReadyRead(int msecs = 30000);
+    qint64 bytesToWrite() const;
+    bool waitForBytesWritten(int msecs = 30000);
+
+    /* Access to received data without consuming it,
+     * readSpans() does not copy, see there
+     */
+    using QIODevice::peek;
+    QByteArray peek(qint64 maxSize);
+    ReadSpans readSpans(qint64 maxSize = -1) const;
+    qint64 consume(qint64 n);
 
 	void setPort(int VID = FTDI_VID, int PID = FTDI_PID) {usbVID = VID; usbPID = PID;}
 	bool setBaudRate(qint32 baud);
 	qint32 baudRate() {return FTDIbaudRate;}
 	bool setLineProperty(LineProperty line);
 	LineProperty lineProperty() {return  FTDIlineProperty;}
+    bool setLatencyTimer(int msecs);
+    int latencyTimer() {return FTDIlatencyTimer;}
+    int currentLatencyTimer() {return FTDIcurrentLatency;}
+    bool setAdaptiveLatency(bool enable, int lowMsecs = FTDI_LATENCY, int highMsecs = FTDI_LATENCY_STREAMING);
+    bool isAdaptiveLatency() {return FTDIadaptiveLatency;}
+    quint64 latencyRaisedCount() {return latencyRaised;}
+    quint64 latencyLoweredCount() {return latencyLowered;}
+    void resetLatencyCounters() {latencyRaised = latencyLowered = 0;}
+    bool setReadTimeout(int msecs);
+    int readTimeout() {return FTDIreadTimeout;}
+    bool setWriteTimeout(int msecs);
+    int writeTimeout() {return FTDIwriteTimeout;}
+    bool setEventCharacter(char c, bool enabled);
+    char eventCharacter() {return FTDIeventChar;}
+    bool isEventCharacterEnabled() {return FTDIeventCharEnabled;}
+    bool setErrorCharacter(char c, bool enabled);
+    char errorCharacter() {return FTDIerrorChar;}
+    bool isErrorCharacterEnabled() {return FTDIerrorCharEnabled;}
+    bool setUsbTransferSize(int inSize, int outSize);
+    int usbInTransferSize() {return FTDIusbInSize;}
+    int usbOutTransferSize() {return FTDIusbOutSize;}
+    QList<TransferTuning> autoTuneTransferSize(QList<int> inSizes = QList<int>(), QList<int> latencies = QList<int>(),
+                                               int msecsPerPoint = FTDI_TUNE_POINT_MSECS);
+    bool applySettings(const FT232Settings &settings);
+    FT232Settings settings() const;
 	bool setFlowControl(FlowControl flow);
 	FlowControl flowControl() {return  FTDIflowControl;}
 	bool setDataTerminalReady(bool set);
@@ -100,6 +381,49 @@ public:
 	PinoutSignals pinoutSignals();
 	PortErrors error() {return errFlag;}
 	void clearError() {errFlag = NoError;}
+    void setThreadedReceive(bool enable) {FTDIthreadedReceive = enable;}
+    bool isThreadedReceive() {return FTDIthreadedReceive;}
+    void setBufferedWrite(bool enable) {FTDIbufferedWrite = enable;}
+    bool isBufferedWrite() {return FTDIbufferedWrite;}
+    void setWriteCoalescing(bool enable, int windowUsecs = FTDI_COALESCING_WINDOW);
+    bool isWriteCoalescing() {return FTDIwriteCoalescing;}
+    int writeCoalescingWindow() {return FTDIcoalescingWindow;}
+    quint64 writeTransfersSaved() {return FTDItransfersSaved.loadAcquire();}
+    int usbPacketSize() {return FTDIpacketSize;}
+    void setTransmitPacing(qint64 bytesPerSecond, qint64 burstBytes);
+    qint64 transmitPacingRate() {return FTDIpacingRate;}
+    qint64 transmitPacingBurst() {return FTDIpacingBurst;}
+    bool flush();
+    qint64 writeV(const QList<QByteArray> &buffers, WritePriority priority = NormalPriority);
+    qint64 writeWithPriority(const QByteArray &data, WritePriority priority);
+    qint64 queuedBytes(WritePriority priority) const;
+    QVector<quint64> queueDelayHistogram(WritePriority priority) const;
+    void resetQueueDelayHistograms();
+    /* Limits of one receive pass, 0 means unlimited */
+    void setReceiveBudget(qint64 maxBytes, int maxUsecs) {FTDIrxBudgetBytes = maxBytes; FTDIrxBudgetUsecs = maxUsecs;}
+    qint64 receiveBudgetBytes() {return FTDIrxBudgetBytes;}
+    int receiveBudgetUsecs() {return FTDIrxBudgetUsecs;}
+    void setReadyReadPolicy(ReadyReadPolicy policy, qint64 thresholdBytes = 0, int delayUsecs = 0);
+    ReadyReadPolicy readyReadPolicy() {return FTDIreadyReadPolicy;}
+    qint64 readyReadThreshold() {return FTDIreadyReadThreshold;}
+    int readyReadDelay() {return FTDIreadyReadDelay;}
+    /* Delivery statistics, to tune the policy */
+    quint64 readyReadEmitted() {return readyReadCount;}
+    quint64 receivedChunks() {return receivedChunkCount;}
+    void resetReadyReadCounters();
+    /* Bounded receive buffer, see setReadBufferSize() */
+    void setReadBufferSize(qint64 size);
+    qint64 readBufferSize() {return FTDIreadBufferSize;}
+    void setReadBufferWatermarks(qint64 high, qint64 low);
+    qint64 highWatermark();
+    qint64 lowWatermark();
+    void setOverflowPolicy(OverflowPolicy policy) {FTDIoverflowPolicy = policy;}
+    OverflowPolicy overflowPolicy() {return FTDIoverflowPolicy;}
+    quint64 overflowCount() {return overflowBytes;}
+    void resetOverflowCount() {overflowBytes = 0;}
+    bool isReceiveThrottled() {return rxThrottled;}
+    void setRtsBackpressure(bool enable);
+    bool isRtsBackpressure() {return FTDIrtsBackpressure;}
 
 	/* FT232 specifics QSerialPortInfo like functions */
 	unsigned int chipID() {return FTDIchipID;}
@@ -113,11 +437,21 @@ public:
 	QByteArray serialNumber() {return serialNmb;}
 
 private:
-	bool FTDIdtr, FTDIrts;
-	LineProperty FTDIlineProperty;
-	FlowControl FTDIflowControl;
+	bool FTDIdtr = false, FTDIrts = false;
+	LineProperty FTDIlineProperty = SERIAL_8N1;
+	FlowControl FTDIflowControl = NoFlowControl;
 	PortErrors errFlag;
     uint32_t FTDIbaudRate = 115200;
+    int FTDIlatencyTimer = FTDI_LATENCY;
+    int FTDIcurrentLatency = FTDI_LATENCY;
+    int FTDIreadTimeout = FTDI_READ_TIMEOUT;
+    int FTDIwriteTimeout = FTDI_WRITE_TIMEOUT;
+    char FTDIeventChar = '\n';
+    bool FTDIeventCharEnabled = false;
+    char FTDIerrorChar = 0;
+    bool FTDIerrorCharEnabled = false;
+    int FTDIusbInSize = 0;
+    int FTDIusbOutSize = 0;
 	int usbVID, usbPID;
 	unsigned int FTDIchipID;
 	QString productName;
@@ -127,11 +461,110 @@ private:
 
 	QMutex ftdiMutex;
     FT_HANDLE ftdi;
-	QByteArray FTDIreadBuffer;
-	QSemaphore sem;
+	FT232RingBuffer FTDIreadBuffer;
+    qint64 FTDIrxBudgetBytes = FTDI_RX_BUDGET_BYTES;
+    int FTDIrxBudgetUsecs = FTDI_RX_BUDGET_USECS;
+
+    void receive(DWORD rxBytes);
+    FT_STATUS readDevice(DWORD len, DWORD *bytesReturned);
+
+    ReadyReadPolicy FTDIreadyReadPolicy = ImmediateReadyRead;
+    qint64 FTDIreadyReadThreshold = 0;
+    int FTDIreadyReadDelay = 0;
+    qint64 undeliveredBytes = 0;
+    QElapsedTimer undeliveredSince;
+    QTimer readyReadTimer;
+    quint64 readyReadCount = 0;
+    quint64 receivedChunkCount = 0;
 
-    QWinEventNotifier * ftdiEventNotifier;
+    void deliver(qint64 received);
+    void emitReadyRead();
 
+    bool FTDIadaptiveLatency = false;
+    int FTDIlatencyLow = FTDI_LATENCY;
+    int FTDIlatencyHigh = FTDI_LATENCY_STREAMING;
+    QElapsedTimer latencyInterval;
+    qint64 latencyBytes = 0;
+    /* Set by write paths on any thread */
+    QAtomicInt latencyWritten;
+    QAtomicInt latencyLowerPending;
+    quint64 latencyRaised = 0;
+    quint64 latencyLowered = 0;
+
+    bool applySettingsAtOpen = false;
+    QString writeLineSettings(const FT232Settings &settings, const FT232Settings *current);
+    bool applyTimeouts();
+    int driverWriteTimeout(int msecs) const {return FTDIbufferedWrite ? qMin(msecs, FTDI_WRITE_SLICE_TIMEOUT) : msecs;}
+    bool applyChars();
+    bool endsFrame(qint64 received) const;
+    void reportWriteTimeout();
+    bool applyLatency(int msecs);
+    void adaptLatency(qint64 received, bool transmitted);
+    void noteTransmitted();
+    bool tuneRun(int inSize, int latency, int msecs, const QByteArray &tx, QByteArray &rx,
+                 TransferTuning &result);
+
+    qint64 FTDIreadBufferSize = 0;
+    qint64 FTDIhighWatermark = 0;
+    qint64 FTDIlowWatermark = 0;
+    OverflowPolicy FTDIoverflowPolicy = DropNewest;
+    quint64 overflowBytes = 0;
+    bool overflowPending = false;
+    bool rxThrottled = false;
+    bool FTDIrtsBackpressure = false;
+    QByteArray discardBuffer;
+
+    bool receivePaused();
+    qint64 admit(qint64 len);
+    FT_STATUS discardDevice(DWORD len);
+    void reportOverflow();
+    void updateThrottle();
+    void setThrottle(bool throttle);
+    bool rtsHeld() const;
+    bool driveRequestToSend(bool hold);
+    FT_STATUS writeRequestToSend(bool hold);
+
+#ifdef _WIN32
+    HANDLE ftdiEvent = NULL;
+    QWinEventNotifier * ftdiEventNotifier = nullptr;
+#else
+    EVENT_HANDLE ftdiEvent;
+    bool ftdiEventCreated = false;
+#endif
+    bool FTDIthreadedReceive = false;
+    FT232ReaderThread * readerThread = nullptr;
+
+    bool FTDIbufferedWrite = false;
+    FT232WriterThread * writerThread = nullptr;
+    bool FTDIwriteCoalescing = false;
+    int FTDIcoalescingWindow = FTDI_COALESCING_WINDOW;
+    int FTDIpacketSize = 64;
+    qint64 FTDIcoalescingLimit = 64 * FTDI_COALESCING_PACKETS;
+    QAtomicInteger<quint64> FTDItransfersSaved;
+    qint64 FTDIpacingRate = 0;
+    qint64 FTDIpacingBurst = 16;
+
+    /* Set while a stream engine owns the handle:
+     * the UART receive path leaves it alone
+     */
+    QAtomicInt FTDIclaimed;
+    bool restoreSettings();
+
+    void stopEventNotification();
+    void stopWriter();
+    friend class FT232ReaderThread;
+    friend class FT232WriterThread;
+    friend class FT232Mpsse;
+    friend class FT232FifoStream;
+    friend class FT232FifoReader;
+    friend class FT232BitBangStream;
+    friend class FT232BitBangWorker;
+
+private slots:
+    void on_FTDIreaderData();
+    void on_FTDIwriterProgress();
+    void on_FTDIdeliveryTimeout();
+    void on_FTDIlatencyLower();
 
 public slots:
     void on_FTDIevent();
@@ -141,14 +574,17 @@ public slots:
 
 protected:
 	qint64 readData(char * data, qint64 maxSize);
+    qint64 readLineData(char *data, qint64 maxSize);
 	qint64 writeData(const char *data, qint64 maxSize);
 
 signals:
 	void baudRateChanged(qint32);
+    void latencyTimerChanged(int);
     void linePropertyChanged(FT232::LineProperty);
     void flowControlChanged(FT232::FlowControl);
 	void dataTerminalReadyChanged(bool);
 	void requestToSendChanged(bool);
+    void settingsChanged(const FT232Settings &settings);
 	void errorOccurred();
 	void readyRead();
 
@@ -156,6 +592,34 @@ signals:
 };
 
 
+/* Port settings as one value
+ *
+ * FT232::applySettings() sets all of them under one lock,
+ * skipping those that did not change, and emits one
+ * settingsChanged() instead of a signal per setting
+ */
+struct FT232Settings
+{
+    qint32 baudRate = 115200;
+    FT232::LineProperty lineProperty = FT232::SERIAL_8N1;
+    FT232::FlowControl flowControl = FT232::NoFlowControl;
+    bool dataTerminalReady = false;
+    bool requestToSend = false;
+    int latencyTimer = FTDI_LATENCY;
+    int readTimeout = FTDI_READ_TIMEOUT;
+    int writeTimeout = FTDI_WRITE_TIMEOUT;
+
+    bool operator==(const FT232Settings &other) const {
+        return baudRate == other.baudRate && lineProperty == other.lineProperty &&
+               flowControl == other.flowControl && dataTerminalReady == other.dataTerminalReady &&
+               requestToSend == other.requestToSend && latencyTimer == other.latencyTimer &&
+               readTimeout == other.readTimeout && writeTimeout == other.writeTimeout;
+    }
+    bool operator!=(const FT232Settings &other) const {return !(*this == other);}
+};
+Q_DECLARE_METATYPE(FT232Settings)
+
+
 /* Info class
  * Similar to QSerialPortInfo class
  */
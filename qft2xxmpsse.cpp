@@ -0,0 +1,916 @@
+/* MPSSE engines for the FT2XX wrapper
+ *
+ * Serial protocol masters (SPI, ...) sharing
+ * the handle opened by the FT232 class
+ *
+ */
+
+#include "qft2xxmpsse.h"
+
+/* Class constructor
+ */
+FT232Mpsse::FT232Mpsse(FT232 *device, QObject *parent)
+	: QObject(parent), device(device)
+{
+}
+
+/* Returns the device to UART mode
+ */
+FT232Mpsse::~FT232Mpsse()
+{
+    end();
+}
+
+/* Switch to MPSSE mode and set the clock
+ *
+ * Three-phase clocking (data valid on both edges)
+ * is what I2C needs
+ */
+bool FT232Mpsse::beginMpsse(int clockHz, bool threePhase)
+{
+    FT_STATUS ret;
+    bool synced = false;
+
+    if (!device || !device->isOpen()) {
+        setErrorString(tr("the device is not open"));
+        return false;
+    }
+    if (clockHz <= 0) {
+        setErrorString(tr("invalid clock rate"));
+        return false;
+    }
+
+	/* Use mutex here to keep the FT232
+     * event handler out of the way
+	 */
+    device->ftdiMutex.lock();
+    ret = FT_SetBitMode(device->ftdi, 0, FT_BITMODE_RESET);
+    if (ret == FT_OK)
+        ret = FT_SetBitMode(device->ftdi, 0, FT_BITMODE_MPSSE);
+    if (ret == FT_OK)
+        ret = FT_Purge(device->ftdi, FT_PURGE_RX | FT_PURGE_TX);
+    if (ret == FT_OK) {
+        synced = synchronize();
+        if (!synced)
+            FT_SetBitMode(device->ftdi, 0, FT_BITMODE_RESET);
+    }
+    device->ftdiMutex.unlock();
+
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while entering MPSSE mode"));
+        return false;
+    }
+    if (!synced) {
+        setErrorString(tr("the device does not answer to MPSSE commands"));
+        return false;
+    }
+    active = true;
+
+    /* Divisor of the 30 MHz maximum, rounded up so
+     * the clock never exceeds clockHz
+     */
+    clockHz = qMin(clockHz, FTDI_MPSSE_CLOCK / 2);
+    int divisor = qBound(0, (FTDI_MPSSE_CLOCK / 2 + clockHz - 1) / clockHz - 1, 0xFFFF);
+    mpsseClock = FTDI_MPSSE_CLOCK / 2 / (divisor + 1);
+
+    commands.resize(0);
+    expectedBytes = 0;
+    appendCommand(0x8A);                        // divide by 5 off
+    appendCommand(0x97);                        // adaptive clocking off
+    appendCommand(threePhase ? 0x8C : 0x8D);    // three-phase clocking
+    appendCommand(0x85);                        // loopback off
+    appendCommand(0x86);                        // clock divisor
+    appendCommand(divisor & 0xFF);
+    appendCommand(divisor >> 8);
+
+    if (!runBatch(nullptr)) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+/* Back to UART mode
+ */
+void FT232Mpsse::end()
+{
+    if (!active)
+        return;
+    active = false;
+    commands.resize(0);
+    expectedBytes = 0;
+
+    if (!device || !device->isOpen())
+        return;
+
+    device->ftdiMutex.lock();
+    FT_SetBitMode(device->ftdi, 0, FT_BITMODE_RESET);
+    FT_Purge(device->ftdi, FT_PURGE_RX | FT_PURGE_TX);
+    device->ftdiMutex.unlock();
+}
+
+/* Send an invalid command: a working MPSSE answers
+ * with 0xFA and the command
+ *
+ * Must be called with ftdiMutex held
+ */
+bool FT232Mpsse::synchronize()
+{
+    uchar bad = 0xAA;
+    uchar reply[2];
+    DWORD n;
+    DWORD queued = 0;
+
+    if (FT_Write(device->ftdi, &bad, 1, &n) != FT_OK || n != 1)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    while (queued < 2) {
+        if (FT_GetQueueStatus(device->ftdi, &queued) != FT_OK)
+            return false;
+        if (queued >= 2)
+            break;
+        if (timer.elapsed() >= FTDI_MPSSE_SYNC_TIMEOUT)
+            return false;
+        QThread::msleep(1);
+    }
+
+    if (FT_Read(device->ftdi, reply, 2, &n) != FT_OK || n != 2)
+        return false;
+
+    return reply[0] == 0xFA && reply[1] == bad;
+}
+
+/* Send the command buffer with one FT_Write and read all
+ * replies with one FT_Read. The buffer is emptied, even
+ * on error. Returns false on error or timeout
+ */
+bool FT232Mpsse::runBatch(QByteArray *response)
+{
+    FT_STATUS ret = FT_OK;
+    DWORD n = 0;
+    qint64 expected = expectedBytes;
+    qint64 written = 0;
+    qint64 received = 0;
+    QByteArray discard;
+
+    if (!response)
+        response = &discard;
+    response->resize(expected);
+
+    /* Have the replies sent back right away */
+    appendCommand(0x87);
+    expectedBytes = 0;
+
+    if (!device || !device->isOpen()) {
+        commands.resize(0);
+        setErrorString(tr("the device is not open"));
+        return false;
+    }
+
+	/* Use mutex here to keep the FT232
+     * event handler from taking the replies
+	 */
+    device->ftdiMutex.lock();
+    while (written < commands.size()) {
+        ret = FT_Write(device->ftdi, commands.data() + written, commands.size() - written, &n);
+        if (ret != FT_OK || n == 0)
+            break;
+        written += n;
+    }
+    while (ret == FT_OK && written == commands.size() && received < expected) {
+        ret = FT_Read(device->ftdi, response->data() + received, expected - received, &n);
+        if (ret != FT_OK || n == 0)
+            break;
+        received += n;
+    }
+    device->ftdiMutex.unlock();
+
+    /* Keep the allocation for the next batch */
+    qint64 size = commands.size();
+    commands.resize(0);
+
+	/* If error, setErrorString */
+    if (ret != FT_OK) {
+        setErrorString(tr("an error occured while running MPSSE commands"));
+        return false;
+    }
+    if (written < size || received < expected) {
+        setErrorString(tr("MPSSE timeout"));
+        return false;
+    }
+
+    return true;
+}
+
+/* Returns the chip type, FT_DEVICE_UNKNOWN on error
+ */
+FT_DEVICE FT232Mpsse::chipType()
+{
+    FT_DEVICE deviceType = FT_DEVICE_UNKNOWN;
+    DWORD usbId;
+
+    if (!device || !device->isOpen())
+        return deviceType;
+
+    device->ftdiMutex.lock();
+    if (FT_GetDeviceInfo(device->ftdi, &deviceType, &usbId, NULL, NULL, NULL) != FT_OK)
+        deviceType = FT_DEVICE_UNKNOWN;
+    device->ftdiMutex.unlock();
+
+    return deviceType;
+}
+
+void FT232Mpsse::appendCommand(uchar command)
+{
+    commands.append((char)command);
+}
+
+/* Set ADBUS0..7 levels and directions (1 = output)
+ */
+void FT232Mpsse::appendLowPins(uchar value, uchar direction)
+{
+    appendCommand(0x80);
+    appendCommand(value);
+    appendCommand(direction);
+}
+
+/* Set ACBUS0..7 levels and directions (1 = output)
+ */
+void FT232Mpsse::appendHighPins(uchar value, uchar direction)
+{
+    appendCommand(0x82);
+    appendCommand(value);
+    appendCommand(direction);
+}
+
+/* Clock data bytes. The opcode tells whether data is
+ * written (bit 4) and whether a reply is read (bit 5);
+ * long data is split into several commands
+ */
+void FT232Mpsse::appendBytes(uchar opcode, const char *data, qint64 len)
+{
+    while (len > 0) {
+        qint64 n = qMin(len, FTDI_MPSSE_MAX_BYTES);
+
+        appendCommand(opcode);
+        appendCommand((n - 1) & 0xFF);
+        appendCommand((n - 1) >> 8);
+        if (opcode & 0x10) {
+            commands.append(data, n);
+            data += n;
+        }
+        if (opcode & 0x20)
+            expectedBytes += n;
+        len -= n;
+    }
+}
+
+/* Clock 1 to 8 bits. Data is written for data out (bit 4)
+ * and TMS (bit 6) opcodes, a read returns one byte
+ */
+void FT232Mpsse::appendBits(uchar opcode, uchar data, int bits)
+{
+    appendCommand(opcode);
+    appendCommand(bits - 1);
+    if (opcode & 0x50)
+        appendCommand(data);
+    if (opcode & 0x20)
+        expectedBytes++;
+}
+
+
+/* Class constructor
+ */
+FT232Spi::FT232Spi(FT232 *device, QObject *parent)
+    : FT232Mpsse(device, parent)
+{
+}
+
+/* Enter MPSSE mode as SPI master
+ *
+ * mode is the SPI mode (0..3, clock polarity and phase),
+ * csPin the ADBUS pin (3..7) used as active low chip select
+ */
+bool FT232Spi::begin(int clockHz, int mode, int csPin)
+{
+    if (mode < 0 || mode > 3 || csPin < 3 || csPin > 7) {
+        setErrorString(tr("invalid SPI mode or chip select pin"));
+        return false;
+    }
+    spiMode = mode;
+    csMask = 1 << csPin;
+
+    /* SCK, MOSI and CS are outputs; SCK idles
+     * high with clock polarity 1
+     */
+    pinDirection = 0x03 | csMask;
+    idlePins = csMask | (mode >= 2 ? 0x01 : 0x00);
+    clear();
+
+    if (!beginMpsse(clockHz, false))
+        return false;
+
+    appendLowPins(idlePins, pinDirection);
+    if (!runBatch(nullptr)) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+/* Queue a write-only transaction. Returns its index
+ */
+int FT232Spi::write(const QByteArray &data)
+{
+    return queue(data, 0, false);
+}
+
+/* Queue a transaction that writes data, then reads readSize
+ * bytes (e.g. a register address and its contents).
+ * Returns its index
+ */
+int FT232Spi::writeRead(const QByteArray &data, qint64 readSize)
+{
+    return queue(data, readSize, false);
+}
+
+/* Queue a full duplex transaction, reading as much as it
+ * writes. Returns its index
+ */
+int FT232Spi::transfer(const QByteArray &data)
+{
+    return queue(data, 0, true);
+}
+
+/* Encode one transaction: CS assert, clock out,
+ * read back, CS deassert
+ */
+int FT232Spi::queue(const QByteArray &data, qint64 readSize, bool fullDuplex)
+{
+    /* Modes 0 and 3 write on the falling edge and read on
+     * the rising one, modes 1 and 2 the other way round
+     */
+    bool fallingOut = spiMode == 0 || spiMode == 3;
+    uchar outOp = fallingOut ? 0x11 : 0x10;
+    uchar inOp = fallingOut ? 0x20 : 0x24;
+    uchar ioOp = fallingOut ? 0x31 : 0x34;
+    Transaction transaction;
+
+    transaction.readOffset = expectedBytes;
+    transaction.readSize = fullDuplex ? data.size() : readSize;
+
+    appendLowPins(idlePins & ~csMask, pinDirection);
+    if (fullDuplex) {
+        appendBytes(ioOp, data.constData(), data.size());
+    } else {
+        appendBytes(outOp, data.constData(), data.size());
+        appendBytes(inOp, nullptr, readSize);
+    }
+    appendLowPins(idlePins, pinDirection);
+
+    transactions.append(transaction);
+    return transactions.size() - 1;
+}
+
+/* Drop the queued transactions
+ */
+void FT232Spi::clear()
+{
+    transactions.clear();
+    commands.resize(0);
+    expectedBytes = 0;
+}
+
+/* Run all queued transactions as one batch: one FT_Write
+ * for the commands, one FT_Read for all replies. Results
+ * are then available through result()
+ */
+bool FT232Spi::execute()
+{
+    if (!active) {
+        setErrorString(tr("MPSSE mode is not active"));
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int count = transactions.size();
+    results = transactions;
+    transactions.clear();
+
+    if (!runBatch(&response)) {
+        results.clear();
+        return false;
+    }
+
+    executedCount += count;
+    batchRate = count * 1e9 / qMax(timer.nsecsElapsed(), (qint64)1);
+
+    return true;
+}
+
+/* Returns what a transaction of the last executed
+ * batch read, empty for write-only transactions
+ */
+QByteArray FT232Spi::result(int transaction) const
+{
+    if (transaction < 0 || transaction >= results.size())
+        return QByteArray();
+
+    const Transaction &t = results.at(transaction);
+    return response.mid(t.readOffset, t.readSize);
+}
+
+
+/* Class constructor
+ */
+FT232I2c::FT232I2c(FT232 *device, QObject *parent)
+    : FT232Mpsse(device, parent)
+{
+}
+
+/* Enter MPSSE mode as I2C master
+ *
+ * I2C needs three-phase clocking, which runs at 2/3
+ * of the MPSSE clock
+ */
+bool FT232I2c::begin(int clockHz)
+{
+    if (clockHz <= 0) {
+        setErrorString(tr("invalid clock rate"));
+        return false;
+    }
+    clear();
+
+    if (!beginMpsse(clockHz * 3 / 2, true))
+        return false;
+    mpsseClock = mpsseClock * 2 / 3;
+
+    /* FT232H can drive the pins low only (open drain),
+     * the other chips rely on the pull-ups winning
+     */
+    driveZeroOnly = chipType() == FT_DEVICE_232H;
+
+    if (driveZeroOnly) {
+        appendCommand(0x9E);
+        appendCommand(0x07);
+        appendCommand(0x00);
+    }
+
+    /* Bus idle: SCL and SDA high */
+    appendPins(0x03, 0x03);
+    if (!runBatch(nullptr)) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+/* Queue writing data to a device. Returns the
+ * transaction index
+ */
+int FT232I2c::write(quint8 address, const QByteArray &data)
+{
+    return queue(address, data, 0);
+}
+
+/* Queue reading size bytes from a device. Returns the
+ * transaction index
+ */
+int FT232I2c::read(quint8 address, int size)
+{
+    return queue(address, QByteArray(), size);
+}
+
+/* Queue writing data (e.g. a register address), then a
+ * repeated start and reading readSize bytes. Returns the
+ * transaction index
+ */
+int FT232I2c::writeRead(quint8 address, const QByteArray &data, int readSize)
+{
+    return queue(address, data, readSize);
+}
+
+/* Encode one transaction. The reply holds one ACK sample
+ * per written byte, followed by the bytes read
+ */
+int FT232I2c::queue(quint8 address, const QByteArray &data, int readSize)
+{
+    Transaction transaction;
+
+    transaction.replyOffset = expectedBytes;
+    transaction.acks = 0;
+    transaction.readSize = readSize;
+
+    appendStart();
+    if (!data.isEmpty() || readSize == 0) {
+        appendWriteByte(address << 1);
+        for (int i = 0; i < data.size(); i++)
+            appendWriteByte(data.at(i));
+        transaction.acks += 1 + data.size();
+    }
+
+    if (readSize > 0) {
+        /* Repeated start after the write phase */
+        if (transaction.acks > 0)
+            appendStart();
+        appendWriteByte((address << 1) | 1);
+        transaction.acks++;
+
+        /* The last byte read is not acknowledged */
+        for (int i = 0; i < readSize; i++)
+            appendReadByte(i < readSize - 1);
+    }
+    appendStop();
+
+    transactions.append(transaction);
+    return transactions.size() - 1;
+}
+
+void FT232I2c::appendPins(uchar value, uchar direction, int repeat)
+{
+    for (int i = 0; i < repeat; i++)
+        appendLowPins(value, direction);
+}
+
+/* SDA falls while SCL is high, then SCL goes low
+ */
+void FT232I2c::appendStart()
+{
+    appendPins(0x03, 0x03, FTDI_I2C_HOLD_REPEAT);
+    appendPins(0x01, 0x03, FTDI_I2C_HOLD_REPEAT);
+    appendPins(0x00, 0x03, FTDI_I2C_HOLD_REPEAT);
+}
+
+/* SDA rises while SCL is high
+ */
+void FT232I2c::appendStop()
+{
+    appendPins(0x00, 0x03, FTDI_I2C_HOLD_REPEAT);
+    appendPins(0x01, 0x03, FTDI_I2C_HOLD_REPEAT);
+    appendPins(0x03, 0x03, FTDI_I2C_HOLD_REPEAT);
+}
+
+/* Clock a byte out, then release SDA and sample
+ * the ACK bit into the reply
+ */
+void FT232I2c::appendWriteByte(uchar byte)
+{
+    appendBytes(0x11, (const char *)&byte, 1);
+    appendPins(0x00, 0x01);
+    appendBits(0x22, 0, 1);
+    appendPins(0x02, 0x03);
+}
+
+/* Release SDA and clock a byte in, then
+ * send ACK (more to read) or NACK
+ */
+void FT232I2c::appendReadByte(bool ack)
+{
+    appendPins(0x00, 0x01);
+    appendBytes(0x20, nullptr, 1);
+    appendPins(0x00, 0x03);
+    appendBits(0x13, ack ? 0x00 : 0xFF, 1);
+    appendPins(0x02, 0x03);
+}
+
+/* Drop the queued transactions
+ */
+void FT232I2c::clear()
+{
+    transactions.clear();
+    commands.resize(0);
+    expectedBytes = 0;
+}
+
+/* Run all queued transactions as one batch, ACK checks
+ * included. A NACK does not stop the batch, see result()
+ */
+bool FT232I2c::execute()
+{
+    if (!active) {
+        setErrorString(tr("MPSSE mode is not active"));
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int count = transactions.size();
+    results = transactions;
+    transactions.clear();
+
+    if (!runBatch(&response)) {
+        results.clear();
+        return false;
+    }
+
+    executedCount += count;
+    batchRate = count * 1e9 / qMax(timer.nsecsElapsed(), (qint64)1);
+
+    return true;
+}
+
+/* Returns the outcome of a transaction of the last
+ * executed batch. Data is only returned if every
+ * written byte was acknowledged
+ */
+FT232I2c::Result FT232I2c::result(int transaction) const
+{
+    Result result;
+    result.nackPosition = -1;
+
+    if (transaction < 0 || transaction >= results.size()) {
+        result.nackPosition = 0;
+        return result;
+    }
+
+    const Transaction &t = results.at(transaction);
+    const char *reply = response.constData() + t.replyOffset;
+
+    /* ACK is a low SDA in bit 0 */
+    for (int i = 0; i < t.acks; i++) {
+        if (reply[i] & 0x01) {
+            result.nackPosition = i;
+            return result;
+        }
+    }
+    result.data = QByteArray(reply + t.acks, t.readSize);
+
+    return result;
+}
+
+/* Returns how many transactions of the last
+ * executed batch got a NACK
+ */
+int FT232I2c::failedTransactions() const
+{
+    int failed = 0;
+
+    for (int i = 0; i < results.size(); i++)
+        if (!result(i).ok())
+            failed++;
+
+    return failed;
+}
+
+
+/* TAP controller state after a TCK with TMS low / high
+ */
+static const FT232Jtag::TapState tapNext[16][2] = {
+    {FT232Jtag::RunTestIdle, FT232Jtag::TestLogicReset},    // TestLogicReset
+    {FT232Jtag::RunTestIdle, FT232Jtag::SelectDrScan},      // RunTestIdle
+    {FT232Jtag::CaptureDr, FT232Jtag::SelectIrScan},        // SelectDrScan
+    {FT232Jtag::ShiftDr, FT232Jtag::Exit1Dr},               // CaptureDr
+    {FT232Jtag::ShiftDr, FT232Jtag::Exit1Dr},               // ShiftDr
+    {FT232Jtag::PauseDr, FT232Jtag::UpdateDr},              // Exit1Dr
+    {FT232Jtag::PauseDr, FT232Jtag::Exit2Dr},               // PauseDr
+    {FT232Jtag::ShiftDr, FT232Jtag::UpdateDr},              // Exit2Dr
+    {FT232Jtag::RunTestIdle, FT232Jtag::SelectDrScan},      // UpdateDr
+    {FT232Jtag::CaptureIr, FT232Jtag::TestLogicReset},      // SelectIrScan
+    {FT232Jtag::ShiftIr, FT232Jtag::Exit1Ir},               // CaptureIr
+    {FT232Jtag::ShiftIr, FT232Jtag::Exit1Ir},               // ShiftIr
+    {FT232Jtag::PauseIr, FT232Jtag::UpdateIr},              // Exit1Ir
+    {FT232Jtag::PauseIr, FT232Jtag::Exit2Ir},               // PauseIr
+    {FT232Jtag::ShiftIr, FT232Jtag::UpdateIr},              // Exit2Ir
+    {FT232Jtag::RunTestIdle, FT232Jtag::SelectDrScan},      // UpdateIr
+};
+
+/* Class constructor
+ */
+FT232Jtag::FT232Jtag(FT232 *device, QObject *parent)
+    : FT232Mpsse(device, parent)
+{
+}
+
+/* Enter MPSSE mode as JTAG master and reset
+ * the TAP to Run-Test/Idle
+ */
+bool FT232Jtag::begin(int clockHz)
+{
+    shifts.clear();
+    results.clear();
+    pendingReply.clear();
+    failed = false;
+
+    if (!beginMpsse(clockHz, false))
+        return false;
+
+    /* TCK, TDI and TMS are outputs, TMS idles high */
+    appendLowPins(0x08, 0x0B);
+    reset();
+    if (!runBatch(nullptr)) {
+        end();
+        return false;
+    }
+
+    return true;
+}
+
+/* Five TCKs with TMS high reach Test-Logic-Reset from
+ * any state, then go on to Run-Test/Idle
+ */
+void FT232Jtag::reset()
+{
+    appendTms(0x1F, 5);
+    tapState = TestLogicReset;
+    goToState(RunTestIdle);
+}
+
+/* Walk the TAP to target along the shortest TMS path
+ */
+void FT232Jtag::goToState(TapState target)
+{
+    quint32 path[16];
+    int length[16];
+    bool seen[16] = {};
+    TapState queue[16];
+    int head = 0, tail = 0;
+
+    /* Breadth first search over the state graph */
+    queue[tail++] = tapState;
+    seen[tapState] = true;
+    path[tapState] = 0;
+    length[tapState] = 0;
+    while (head < tail && !seen[target]) {
+        TapState state = queue[head++];
+        for (int tms = 0; tms < 2; tms++) {
+            TapState next = tapNext[state][tms];
+            if (seen[next])
+                continue;
+            seen[next] = true;
+            path[next] = path[state] | (tms << length[state]);
+            length[next] = length[state] + 1;
+            queue[tail++] = next;
+        }
+    }
+
+    appendTms(path[target], length[target]);
+    tapState = target;
+}
+
+/* Clock TCK cycles in Run-Test/Idle
+ */
+void FT232Jtag::runTest(int cycles)
+{
+    goToState(RunTestIdle);
+
+    /* TMS stays low: clock without data, in
+     * units of 8 cycles, then the remainder
+     */
+    while (cycles >= 8) {
+        int units = qMin(cycles / 8, 65536);
+        appendCommand(0x8F);
+        appendCommand((units - 1) & 0xFF);
+        appendCommand((units - 1) >> 8);
+        cycles -= units * 8;
+    }
+    if (cycles > 0) {
+        appendCommand(0x8E);
+        appendCommand(cycles - 1);
+    }
+}
+
+/* Queue an instruction register shift of bits bits, TDI
+ * LSB first. With capture, TDO is returned by tdo() after
+ * flush(). Returns the shift index, -1 on error
+ */
+int FT232Jtag::shiftIr(const QByteArray &tdi, int bits, bool capture, TapState endState)
+{
+    return shift(true, tdi, bits, capture, endState);
+}
+
+/* Queue a data register shift, see shiftIr()
+ */
+int FT232Jtag::shiftDr(const QByteArray &tdi, int bits, bool capture, TapState endState)
+{
+    return shift(false, tdi, bits, capture, endState);
+}
+
+/* All bits but the last are clocked as bytes and bits,
+ * the last one together with TMS high to leave Shift
+ */
+int FT232Jtag::shift(bool ir, const QByteArray &tdi, int bits, bool capture, TapState endState)
+{
+    Shift shift;
+
+    if (bits <= 0)
+        return -1;
+
+    /* Missing TDI bits are zeros */
+    QByteArray data = tdi.left((bits + 7) / 8);
+    if (data.size() < (bits + 7) / 8)
+        data.append(QByteArray((bits + 7) / 8 - data.size(), 0));
+
+    goToState(ir ? ShiftIr : ShiftDr);
+
+    shift.bits = bits;
+    shift.replyOffset = capture ? pendingReply.size() + expectedBytes : -1;
+
+    int body = bits - 1;
+    int fullBytes = body / 8;
+    int rem = body % 8;
+    uchar last = (data.at(fullBytes) >> rem) & 0x01;
+
+    appendBytes(capture ? 0x39 : 0x19, data.constData(), fullBytes);
+    if (rem > 0)
+        appendBits(capture ? 0x3B : 0x1B, data.at(fullBytes), rem);
+    appendBits(capture ? 0x6B : 0x4B, 0x01 | (last << 7), 1);
+    tapState = ir ? Exit1Ir : Exit1Dr;
+
+    goToState(endState);
+    shifts.append(shift);
+
+    /* Do not let too many replies pend */
+    if (expectedBytes >= FTDI_JTAG_MAX_REPLY)
+        sendPending();
+
+    return shifts.size() - 1;
+}
+
+/* Clock up to 32 TMS bits, LSB first, 7 per command
+ */
+void FT232Jtag::appendTms(quint32 tms, int count)
+{
+    while (count > 0) {
+        int n = qMin(count, 7);
+
+        appendBits(0x4B, tms & ((1 << n) - 1), n);
+        tms >>= n;
+        count -= n;
+    }
+}
+
+/* Send what is queued so far, keeping the replies
+ * for flush()
+ */
+bool FT232Jtag::sendPending()
+{
+    QByteArray reply;
+
+    if (failed || !runBatch(&reply)) {
+        commands.resize(0);
+        expectedBytes = 0;
+        failed = true;
+        return false;
+    }
+    pendingReply.append(reply);
+
+    return true;
+}
+
+/* Flush point: send the queued operations and read back
+ * TDO of all captured shifts since the last flush
+ */
+bool FT232Jtag::flush()
+{
+    if (!active) {
+        setErrorString(tr("MPSSE mode is not active"));
+        return false;
+    }
+
+    bool ok = sendPending();
+
+    results = shifts;
+    shifts.clear();
+    response.swap(pendingReply);
+    pendingReply.clear();
+    failed = false;
+
+    if (!ok)
+        results.clear();
+
+    return ok;
+}
+
+/* Returns TDO of a captured shift of the last flush,
+ * LSB first like TDI
+ */
+QByteArray FT232Jtag::tdo(int shift) const
+{
+    if (shift < 0 || shift >= results.size() || results.at(shift).replyOffset < 0)
+        return QByteArray();
+
+    const Shift &s = results.at(shift);
+    const uchar *reply = (const uchar *)response.constData() + s.replyOffset;
+    int body = s.bits - 1;
+    int fullBytes = body / 8;
+    int rem = body % 8;
+    QByteArray out((s.bits + 7) / 8, 0);
+
+    memcpy(out.data(), reply, fullBytes);
+    reply += fullBytes;
+
+    /* Bit reads shift in from the top */
+    if (rem > 0)
+        out[fullBytes] = *reply++ >> (8 - rem);
+    out[fullBytes] = out.at(fullBytes) | (((*reply >> 7) & 0x01) << rem);
+
+    return out;
+}
@@ -0,0 +1,244 @@
+#ifndef QFT2XXMPSSE_H
+#define QFT2XXMPSSE_H
+
+#include "qft2xx.h"
+
+/* MPSSE base clock with divide by 5 disabled (Hz) */
+static constexpr int FTDI_MPSSE_CLOCK           =   60000000;
+/* Longest clock data command, in bytes */
+static constexpr qint64 FTDI_MPSSE_MAX_BYTES    =   65536;
+/* How long to wait for the MPSSE to synchronize (ms) */
+static constexpr int FTDI_MPSSE_SYNC_TIMEOUT    =   500;
+/* Pin state repetitions giving I2C start/stop hold times */
+static constexpr int FTDI_I2C_HOLD_REPEAT       =   4;
+/* TDO bytes a JTAG batch may pend before it is sent
+ * on its own, keeping the driver's receive queue small
+ */
+static constexpr qint64 FTDI_JTAG_MAX_REPLY     =   32768;
+
+
+/* MPSSE command engine
+ *
+ * Base of the MPSSE masters (FT232H, FT2232H, FT4232H). It
+ * switches the handle opened by FT232::open() to MPSSE mode
+ * and collects commands in a buffer, so a whole batch of
+ * operations costs one FT_Write and one FT_Read instead of
+ * a USB round trip per byte.
+ *
+ * ftdiMutex is held over a batch, which keeps the FT232
+ * receive path from taking the MPSSE replies. Nothing must
+ * be written through the FT232 meanwhile.
+ */
+class FT232Mpsse : public QObject
+{
+    Q_OBJECT
+
+public:
+    FT232Mpsse(FT232 *device, QObject *parent = nullptr);
+    virtual ~FT232Mpsse();
+
+    bool isActive() {return active;}
+    int clockRate() {return mpsseClock;}
+    void end();
+
+    QString errorString() {return errString;}
+
+protected:
+    bool beginMpsse(int clockHz, bool threePhase);
+    bool runBatch(QByteArray *response);
+    FT_DEVICE chipType();
+
+    void appendCommand(uchar command);
+    void appendLowPins(uchar value, uchar direction);
+    void appendHighPins(uchar value, uchar direction);
+    void appendBytes(uchar opcode, const char *data, qint64 len);
+    void appendBits(uchar opcode, uchar data, int bits);
+
+    void setErrorString(const QString &error) {errString = error;}
+
+    QPointer<FT232> device;
+    QByteArray commands;
+    qint64 expectedBytes = 0;
+    bool active = false;
+    int mpsseClock = 0;
+
+private:
+    bool synchronize();
+
+    QString errString;
+};
+
+
+/* SPI master over MPSSE
+ *
+ * Transactions are only queued: each one asserts chip
+ * select, clocks its data out, reads back and deasserts
+ * chip select. execute() sends all queued transactions as
+ * one command buffer and reads all replies in one go.
+ *
+ * SCK, MOSI and MISO are ADBUS0..2, chip select is ADBUS3
+ * unless set otherwise in begin().
+ */
+class FT232Spi : public FT232Mpsse
+{
+    Q_OBJECT
+
+public:
+    FT232Spi(FT232 *device, QObject *parent = nullptr);
+
+    bool begin(int clockHz, int mode = 0, int csPin = 3);
+
+    int write(const QByteArray &data);
+    int writeRead(const QByteArray &data, qint64 readSize);
+    int transfer(const QByteArray &data);
+    int queuedTransactions() {return transactions.size();}
+    void clear();
+    bool execute();
+
+    QByteArray result(int transaction) const;
+
+    /* Batch statistics */
+    quint64 executedTransactions() {return executedCount;}
+    double transactionsPerSecond() {return batchRate;}
+
+private:
+    struct Transaction {
+        qint64 readOffset;
+        qint64 readSize;
+    };
+
+    int queue(const QByteArray &data, qint64 readSize, bool fullDuplex);
+
+    int spiMode = 0;
+    uchar csMask = 0x08;
+    uchar idlePins = 0x08;
+    uchar pinDirection = 0x0B;
+    QList<Transaction> transactions;
+    QList<Transaction> results;
+    QByteArray response;
+    quint64 executedCount = 0;
+    double batchRate = 0;
+};
+
+
+/* I2C master over MPSSE
+ *
+ * Like FT232Spi, transactions are queued and execute()
+ * runs them all with one FT_Write and one FT_Read: the
+ * ACK bit of every written byte is sampled into the same
+ * reply. Each transaction keeps its own result, so a NACK
+ * only fails that transaction and tells where it happened.
+ *
+ * SCL is ADBUS0, SDA is ADBUS1 (out) tied to ADBUS2 (in).
+ */
+class FT232I2c : public FT232Mpsse
+{
+    Q_OBJECT
+
+public:
+    /* Outcome of one transaction */
+    struct Result {
+        /* Index of the first written byte that was not
+         * acknowledged (0 is the address), -1 if none
+         */
+        int nackPosition;
+        QByteArray data;
+        bool ok() const {return nackPosition < 0;}
+    };
+
+    FT232I2c(FT232 *device, QObject *parent = nullptr);
+
+    bool begin(int clockHz = 100000);
+
+    int write(quint8 address, const QByteArray &data);
+    int read(quint8 address, int size);
+    int writeRead(quint8 address, const QByteArray &data, int readSize);
+    int queuedTransactions() {return transactions.size();}
+    void clear();
+    bool execute();
+
+    Result result(int transaction) const;
+    int failedTransactions() const;
+
+    /* Batch statistics */
+    quint64 executedTransactions() {return executedCount;}
+    double transactionsPerSecond() {return batchRate;}
+
+private:
+    struct Transaction {
+        qint64 replyOffset;
+        int acks;
+        int readSize;
+    };
+
+    int queue(quint8 address, const QByteArray &data, int readSize);
+    void appendPins(uchar value, uchar direction, int repeat = 1);
+    void appendStart();
+    void appendStop();
+    void appendWriteByte(uchar byte);
+    void appendReadByte(bool ack);
+
+    bool driveZeroOnly = false;
+    QList<Transaction> transactions;
+    QList<Transaction> results;
+    QByteArray response;
+    quint64 executedCount = 0;
+    double batchRate = 0;
+};
+
+
+/* JTAG engine over MPSSE
+ *
+ * IR/DR shifts and TAP state walks are only encoded into
+ * the command buffer, TDO is read back at flush(): a whole
+ * boundary scan costs a single USB round trip instead of
+ * one per shift. Large batches are sent on their own as
+ * replies pile up, results are still kept until flush().
+ *
+ * TCK, TDI, TDO and TMS are ADBUS0..3.
+ */
+class FT232Jtag : public FT232Mpsse
+{
+    Q_OBJECT
+
+public:
+    enum TapState {TestLogicReset, RunTestIdle,
+                   SelectDrScan, CaptureDr, ShiftDr, Exit1Dr, PauseDr, Exit2Dr, UpdateDr,
+                   SelectIrScan, CaptureIr, ShiftIr, Exit1Ir, PauseIr, Exit2Ir, UpdateIr};
+    Q_ENUM(TapState)
+
+    FT232Jtag(FT232 *device, QObject *parent = nullptr);
+
+    bool begin(int clockHz);
+
+    void reset();
+    void goToState(TapState target);
+    void runTest(int cycles);
+    int shiftIr(const QByteArray &tdi, int bits, bool capture = false, TapState endState = RunTestIdle);
+    int shiftDr(const QByteArray &tdi, int bits, bool capture = false, TapState endState = RunTestIdle);
+    TapState state() {return tapState;}
+    int pendingShifts() {return shifts.size();}
+    bool flush();
+
+    QByteArray tdo(int shift) const;
+
+private:
+    struct Shift {
+        qint64 replyOffset;
+        int bits;
+    };
+
+    int shift(bool ir, const QByteArray &tdi, int bits, bool capture, TapState endState);
+    void appendTms(quint32 tms, int count);
+    bool sendPending();
+
+    TapState tapState = TestLogicReset;
+    QList<Shift> shifts;
+    QList<Shift> results;
+    QByteArray pendingReply;
+    QByteArray response;
+    bool failed = false;
+};
+
+
+#endif // QFT2XXMPSSE_H
@@ -0,0 +1,595 @@
+/* Streaming engines for the FT2XX wrapper
+ *
+ * High rate bit mode streams (synchronous FIFO and
+ * synchronous bit-bang) sharing the handle opened by
+ * the FT232 class
+ *
+ */
+
+#include "qft2xxstream.h"
+
+/* FIFO reader thread
+ *
+ * Reads whole blocks into free slots of the stream's
+ * chunk queue. A read timeout only leaves the block
+ * partly filled, it is completed by the next read.
+ * Without a free slot the block goes to a scratch buffer
+ * and is dropped, so the chip is always drained.
+ */
+class FT232FifoReader : public QThread
+{
+public:
+    FT232FifoReader(FT232FifoStream *stream) : stream(stream) {}
+
+protected:
+    void run();
+
+private:
+    FT232FifoStream *stream;
+};
+
+void FT232FifoReader::run()
+{
+    FT232 *device = stream->device;
+    qint64 blockSize = stream->blockSize;
+    QByteArray scratch(blockSize, Qt::Uninitialized);
+    char *block = nullptr;
+    qint64 filled = 0;
+    bool dropping = false;
+    DWORD bytesReturned;
+    FT_STATUS ret;
+
+    while (!stream->stopRequested.loadAcquire())
+    {
+        if (filled == 0) {
+            block = stream->queue->writeSlot();
+            dropping = block == nullptr;
+            if (dropping)
+                block = scratch.data();
+        }
+
+        /* Use mutex here to avoid reading
+         * while the owner is configuring
+         */
+        device->ftdiMutex.lock();
+        ret = FT_Read(device->ftdi, block + filled, blockSize - filled, &bytesReturned);
+        device->ftdiMutex.unlock();
+
+        if (ret != FT_OK) {
+            QMetaObject::invokeMethod(stream, "on_readerError", Qt::QueuedConnection);
+            break;
+        }
+
+        filled += bytesReturned;
+        if (filled < blockSize)
+            continue;
+        filled = 0;
+
+        if (dropping) {
+            stream->droppedCount.fetchAndAddOrdered(1);
+            continue;
+        }
+
+        stream->queue->publish(blockSize);
+        stream->receivedCount.fetchAndAddOrdered(1);
+
+        stream->mutex.lock();
+        stream->dataCondition.wakeOne();
+        stream->mutex.unlock();
+    }
+}
+
+/* FIFO consumer thread
+ *
+ * Hands full blocks to the callback and gives their
+ * slots back to the reader. On stop, what was already
+ * received is still delivered
+ */
+class FT232FifoConsumer : public QThread
+{
+public:
+    FT232FifoConsumer(FT232FifoStream *stream) : stream(stream) {}
+
+protected:
+    void run();
+
+private:
+    FT232FifoStream *stream;
+};
+
+void FT232FifoConsumer::run()
+{
+    qint64 len;
+
+    while (true)
+    {
+        const char *block = stream->queue->readSlot(&len);
+        if (!block) {
+            if (stream->stopRequested.loadAcquire())
+                break;
+
+            /* Check again under the lock, so a
+             * wakeup is not lost
+             */
+            stream->mutex.lock();
+            if (!stream->queue->readSlot(&len) && !stream->stopRequested.loadAcquire())
+                stream->dataCondition.wait(&stream->mutex, FTDI_FIFO_READ_TIMEOUT);
+            stream->mutex.unlock();
+            continue;
+        }
+
+        stream->consumer(block, len);
+        stream->queue->release();
+    }
+}
+
+
+/* Class constructor
+ */
+FT232FifoStream::FT232FifoStream(FT232 *device, QObject *parent)
+    : QObject(parent), device(device)
+{
+}
+
+/* Stops streaming and restores UART mode
+ */
+FT232FifoStream::~FT232FifoStream()
+{
+    stop();
+}
+
+/* Switch to synchronous FIFO mode and start streaming
+ * blocks of blockSize bytes to consumer, with up to
+ * blocks of them waiting for the consumer
+ */
+bool FT232FifoStream::start(qint64 size, const BlockConsumer &callback, int blocks)
+{
+    FT_STATUS ret;
+
+    if (reader) {
+        errString = tr("the stream is already running");
+        return false;
+    }
+    if (!device || !device->isOpen()) {
+        errString = tr("the device is not open");
+        return false;
+    }
+    if (size <= 0 || blocks < 2 || !callback) {
+        errString = tr("invalid block size or consumer");
+        return false;
+    }
+
+    /* Keep the UART receive path away from the data */
+    device->FTDIclaimed.storeRelease(1);
+
+	/* Reset the bit mode first, then synchronous FIFO with
+     * the largest USB transfers, a short latency timer and
+     * RTS/CTS flow control as the FT245 protocol needs.
+     * Reads time out quickly, so stop() is not held up
+	 */
+    device->ftdiMutex.lock();
+    ret = FT_SetBitMode(device->ftdi, 0xFF, FT_BITMODE_RESET);
+    if (ret == FT_OK)
+        ret = FT_SetBitMode(device->ftdi, 0xFF, FT_BITMODE_SYNC_FIFO);
+    if (ret == FT_OK)
+        ret = FT_SetLatencyTimer(device->ftdi, FTDI_FIFO_LATENCY);
+    if (ret == FT_OK)
+        ret = FT_SetUSBParameters(device->ftdi, FTDI_USB_TRANSFER_MAX, FTDI_USB_TRANSFER_MAX);
+    if (ret == FT_OK)
+        ret = FT_SetFlowControl(device->ftdi, FT_FLOW_RTS_CTS, 0, 0);
+    if (ret == FT_OK)
+        ret = FT_SetTimeouts(device->ftdi, FTDI_FIFO_READ_TIMEOUT, device->writeTimeout());
+    if (ret == FT_OK)
+        ret = FT_Purge(device->ftdi, FT_PURGE_RX | FT_PURGE_TX);
+    if (ret != FT_OK)
+        device->restoreSettings();
+    device->ftdiMutex.unlock();
+
+    if (ret != FT_OK) {
+        device->FTDIclaimed.storeRelease(0);
+        errString = tr("an error occured while entering synchronous FIFO mode");
+        return false;
+    }
+
+    blockSize = size;
+    consumer = callback;
+    queue = new FT232ChunkQueue(blocks, size);
+    stopRequested.storeRelease(0);
+    receivedCount.storeRelease(0);
+    droppedCount.storeRelease(0);
+    streamNsecs = 0;
+    clock.start();
+
+    consumerThread = new FT232FifoConsumer(this);
+    consumerThread->start(QThread::HighPriority);
+    reader = new FT232FifoReader(this);
+    reader->start(QThread::TimeCriticalPriority);
+
+    return true;
+}
+
+/* Stop both threads, deliver what was received
+ * and return the device to UART mode
+ */
+void FT232FifoStream::stop()
+{
+    if (!reader)
+        return;
+
+    stopRequested.storeRelease(1);
+    mutex.lock();
+    dataCondition.wakeOne();
+    mutex.unlock();
+
+    reader->wait();
+    consumerThread->wait();
+    streamNsecs = clock.nsecsElapsed();
+
+    delete reader;
+    reader = nullptr;
+    delete consumerThread;
+    consumerThread = nullptr;
+    delete queue;
+    queue = nullptr;
+
+    if (device && device->isOpen()) {
+        device->ftdiMutex.lock();
+        if (!device->restoreSettings())
+            errString = tr("an error occured while restoring UART mode");
+        device->ftdiMutex.unlock();
+        device->FTDIclaimed.storeRelease(0);
+    }
+}
+
+/* Sustained throughput in bytes per second, dropped
+ * blocks included: what the link actually carried
+ */
+double FT232FifoStream::throughput()
+{
+    qint64 nsecs = reader ? clock.nsecsElapsed() : streamNsecs;
+    quint64 blocks = receivedCount.loadAcquire() + droppedCount.loadAcquire();
+
+    if (nsecs <= 0)
+        return 0;
+
+    return blocks * (double)blockSize * 1e9 / nsecs;
+}
+
+/* Reader thread stopped on a device error
+ */
+void FT232FifoStream::on_readerError()
+{
+    errString = tr("an error occured while reading the FIFO");
+    emit errorOccurred();
+}
+
+
+/* Bit-bang worker thread
+ *
+ * Keeps two chunks of pattern queued in the driver and
+ * reads back the samples of the oldest one, so the next
+ * chunk is generated while the device clocks the current
+ * one. Finding every queued sample already received when
+ * writing means the device went idle: an underrun.
+ */
+class FT232BitBangWorker : public QThread
+{
+public:
+    FT232BitBangWorker(FT232BitBangStream *stream) : stream(stream) {}
+
+protected:
+    void run();
+
+private:
+    void notify();
+
+    FT232BitBangStream *stream;
+};
+
+void FT232BitBangWorker::run()
+{
+    FT232 *device = stream->device;
+    qint64 chunkSize = stream->chunkSize;
+    QByteArray pattern[2] = {QByteArray(chunkSize, Qt::Uninitialized),
+                             QByteArray(chunkSize, Qt::Uninitialized)};
+    QByteArray input(chunkSize, Qt::Uninitialized);
+    qint64 chunkLength[2] = {0, 0};
+    int oldest = 0;
+    int pending = 0;
+    qint64 queued = 0;
+    bool generating = true;
+    bool failed = false;
+    QElapsedTimer stalled;
+    DWORD bytesDone;
+    DWORD rxBytes;
+    FT_STATUS ret;
+
+    while (!failed && !stream->stopRequested.loadAcquire())
+    {
+        /* Top up to two chunks in flight */
+        if (generating && pending < 2) {
+            int slot = (oldest + pending) % 2;
+            qint64 len = stream->generator(pattern[slot].data(), chunkSize);
+            if (len <= 0) {
+                generating = false;
+                continue;
+            }
+            len = qMin(len, chunkSize);
+
+            device->ftdiMutex.lock();
+            if (pending > 0 && FT_GetQueueStatus(device->ftdi, &rxBytes) == FT_OK
+                    && rxBytes >= (DWORD)queued)
+                stream->underrunCount.fetchAndAddOrdered(1);
+            device->ftdiMutex.unlock();
+
+            /* The mutex is released between attempts, a device
+             * taking nothing for the write timeout has failed
+             */
+            qint64 written = 0;
+            stalled.start();
+            while (written < len && !stream->stopRequested.loadAcquire()) {
+                device->ftdiMutex.lock();
+                ret = FT_Write(device->ftdi, pattern[slot].data() + written, len - written, &bytesDone);
+                device->ftdiMutex.unlock();
+                if (ret != FT_OK) {
+                    failed = true;
+                    break;
+                }
+
+                if (bytesDone > 0) {
+                    written += bytesDone;
+                    stalled.start();
+                }
+                else if (stalled.elapsed() >= device->writeTimeout()) {
+                    failed = true;
+                    break;
+                }
+            }
+
+            if (written < len)
+                continue;
+
+            chunkLength[slot] = len;
+            pending++;
+            queued += len;
+            stream->writtenCount.fetchAndAddOrdered(len);
+            continue;
+        }
+
+        /* Generator done and every sample read back */
+        if (pending == 0)
+            break;
+
+        /* One sample per written byte: read the whole
+         * oldest chunk back, reads time out quickly
+         * so stop() is not held up
+         */
+        qint64 len = chunkLength[oldest];
+        qint64 got = 0;
+        while (got < len && !stream->stopRequested.loadAcquire()) {
+            device->ftdiMutex.lock();
+            ret = FT_Read(device->ftdi, input.data() + got, len - got, &bytesDone);
+            device->ftdiMutex.unlock();
+            if (ret != FT_OK) {
+                failed = true;
+                break;
+            }
+            got += bytesDone;
+        }
+
+        if (got > 0) {
+            stream->samplesMutex.lock();
+            stream->samples.append(input.constData(), got);
+            stream->samplesMutex.unlock();
+            stream->sampledCount.fetchAndAddOrdered(got);
+            notify();
+        }
+
+        oldest = (oldest + 1) % 2;
+        pending--;
+        queued -= len;
+    }
+
+    if (failed)
+        stream->workerFailed.storeRelease(1);
+    stream->workerDone.storeRelease(1);
+    notify();
+}
+
+/* Wake the owner thread, once until it has caught up
+ */
+void FT232BitBangWorker::notify()
+{
+    if (stream->notifyPending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(stream, "on_workerProgress", Qt::QueuedConnection);
+}
+
+
+/* Class constructor
+ */
+FT232BitBangStream::FT232BitBangStream(FT232 *device, QObject *parent)
+    : QObject(parent), device(device)
+{
+}
+
+/* Stops streaming and restores UART mode
+ */
+FT232BitBangStream::~FT232BitBangStream()
+{
+    stop();
+}
+
+/* Switch to synchronous bit-bang with the pins of outputMask
+ * driven, clocked at rate samples per second, and stream
+ * the pattern produced by generator
+ */
+bool FT232BitBangStream::start(quint8 outputMask, int rate, const PatternGenerator &patternGenerator,
+                               qint64 size)
+{
+    FT_STATUS ret;
+
+    if (worker) {
+        errString = tr("the stream is already running");
+        return false;
+    }
+    if (!device || !device->isOpen()) {
+        errString = tr("the device is not open");
+        return false;
+    }
+    if (rate <= 0 || size <= 0 || !patternGenerator) {
+        errString = tr("invalid sample rate, chunk size or pattern");
+        return false;
+    }
+
+    /* Keep the UART receive path away from the samples */
+    device->FTDIclaimed.storeRelease(1);
+
+    /* Reset the bit mode first, then synchronous bit-bang.
+     * The bit-bang clock derives from the baud rate, without
+     * flow control nothing holds the pattern back.
+     * Reads time out quickly, so stop() is not held up
+     */
+    device->ftdiMutex.lock();
+    ret = FT_SetBitMode(device->ftdi, 0x00, FT_BITMODE_RESET);
+    if (ret == FT_OK)
+        ret = FT_SetBitMode(device->ftdi, outputMask, FT_BITMODE_SYNC_BITBANG);
+    if (ret == FT_OK)
+        ret = FT_SetBaudRate(device->ftdi, qMax(1, rate / FTDI_BITBANG_CLOCK_FACTOR));
+    if (ret == FT_OK)
+        ret = FT_SetFlowControl(device->ftdi, FT_FLOW_NONE, 0, 0);
+    if (ret == FT_OK)
+        ret = FT_SetTimeouts(device->ftdi, FTDI_FIFO_READ_TIMEOUT, device->writeTimeout());
+    if (ret == FT_OK)
+        ret = FT_Purge(device->ftdi, FT_PURGE_RX | FT_PURGE_TX);
+    if (ret != FT_OK)
+        device->restoreSettings();
+    device->ftdiMutex.unlock();
+
+    if (ret != FT_OK) {
+        device->FTDIclaimed.storeRelease(0);
+        errString = tr("an error occured while entering synchronous bit-bang mode");
+        return false;
+    }
+
+    chunkSize = size;
+    generator = patternGenerator;
+    samples.clear();
+    stopRequested.storeRelease(0);
+    notifyPending.storeRelease(0);
+    workerDone.storeRelease(0);
+    workerFailed.storeRelease(0);
+    writtenCount.storeRelease(0);
+    sampledCount.storeRelease(0);
+    underrunCount.storeRelease(0);
+    streamNsecs = 0;
+    clock.start();
+
+    worker = new FT232BitBangWorker(this);
+    worker->start(QThread::TimeCriticalPriority);
+
+    return true;
+}
+
+/* Same as above, streaming pattern once
+ */
+bool FT232BitBangStream::start(quint8 outputMask, int rate, const QByteArray &pattern, qint64 size)
+{
+    qint64 offset = 0;
+
+    if (pattern.isEmpty()) {
+        errString = tr("invalid sample rate, chunk size or pattern");
+        return false;
+    }
+
+    return start(outputMask, rate, [pattern, offset](char *data, qint64 maxSize) mutable -> qint64 {
+        qint64 len = qMin(maxSize, (qint64)pattern.size() - offset);
+        memcpy(data, pattern.constData() + offset, len);
+        offset += len;
+        return len;
+    }, size);
+}
+
+/* Stop the worker and return the device to UART mode,
+ * samples already read back stay available
+ */
+void FT232BitBangStream::stop()
+{
+    if (!worker)
+        return;
+
+    stopRequested.storeRelease(1);
+    worker->wait();
+    streamNsecs = clock.nsecsElapsed();
+
+    delete worker;
+    worker = nullptr;
+
+    if (device && device->isOpen()) {
+        device->ftdiMutex.lock();
+        if (!device->restoreSettings())
+            errString = tr("an error occured while restoring UART mode");
+        device->ftdiMutex.unlock();
+        device->FTDIclaimed.storeRelease(0);
+    }
+}
+
+/* Number of sampled bytes waiting in readSamples()
+ */
+qint64 FT232BitBangStream::samplesAvailable()
+{
+    QMutexLocker locker(&samplesMutex);
+
+    return samples.size();
+}
+
+/* Take up to maxSize sampled bytes, all of them if negative
+ */
+QByteArray FT232BitBangStream::readSamples(qint64 maxSize)
+{
+    QMutexLocker locker(&samplesMutex);
+    QByteArray data;
+
+    if (maxSize < 0 || maxSize > samples.size())
+        maxSize = samples.size();
+
+    data.resize(maxSize);
+    samples.read(data.data(), maxSize);
+
+    return data;
+}
+
+/* Effective sample rate in samples per second: what the
+ * device actually clocked, idle gaps included
+ */
+double FT232BitBangStream::sampleRate()
+{
+    qint64 nsecs = worker ? clock.nsecsElapsed() : streamNsecs;
+
+    if (nsecs <= 0)
+        return 0;
+
+    return sampledCount.loadAcquire() * 1e9 / nsecs;
+}
+
+/* Worker thread has new samples or has ended
+ */
+void FT232BitBangStream::on_workerProgress()
+{
+    notifyPending.storeRelease(0);
+
+    if (samplesAvailable() > 0)
+        emit samplesReady();
+
+    if (!worker || !workerDone.loadAcquire())
+        return;
+
+    bool failed = workerFailed.loadAcquire();
+    stop();
+
+    if (failed) {
+        errString = tr("an error occured while streaming the bit-bang pattern");
+        emit errorOccurred();
+    } else {
+        emit finished();
+    }
+}
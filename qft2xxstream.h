@@ -0,0 +1,183 @@
+#ifndef QFT2XXSTREAM_H
+#define QFT2XXSTREAM_H
+
+#include <functional>
+
+#include "qft2xx.h"
+
+/* Blocks in flight between the FIFO reader and consumer */
+static constexpr int FTDI_FIFO_BLOCKS           =   8;
+/* Latency timer of synchronous FIFO mode (ms) */
+static constexpr int FTDI_FIFO_LATENCY          =   2;
+/* Read timeout while streaming, bounds how long stop() waits (ms) */
+static constexpr int FTDI_FIFO_READ_TIMEOUT     =   100;
+/* Bytes per synchronous bit-bang write, two are kept in flight */
+static constexpr qint64 FTDI_BITBANG_CHUNK      =   4096;
+/* Bit-bang clock is this many times the baud rate */
+static constexpr int FTDI_BITBANG_CLOCK_FACTOR  =   16;
+
+class FT232FifoReader;
+class FT232FifoConsumer;
+class FT232BitBangWorker;
+
+
+/* FT245 synchronous FIFO streaming
+ *
+ * For FT232H and FT2232H (channel A) wired to an FPGA or
+ * ADC in synchronous 245 FIFO mode. start() switches the
+ * handle opened by FT232::open() to bit mode 0x40 with
+ * 64 KB USB transfers, so the driver keeps several large
+ * USB requests in flight, and starts two threads:
+ *
+ * the reader reads fixed-size blocks straight into a ring
+ * of buffers, and the consumer thread hands each full block
+ * to the callback. When the consumer falls behind and no
+ * buffer is free, the reader keeps draining the chip and
+ * drops the block, counted by droppedBlocks().
+ *
+ * The UART receive path of the FT232 is suspended while
+ * streaming; stop() restores UART mode and its settings.
+ */
+class FT232FifoStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    /* Called on the consumer thread with one full block */
+    typedef std::function<void(const char *data, qint64 size)> BlockConsumer;
+
+    FT232FifoStream(FT232 *device, QObject *parent = nullptr);
+    virtual ~FT232FifoStream();
+
+    bool start(qint64 blockSize, const BlockConsumer &consumer, int blocks = FTDI_FIFO_BLOCKS);
+    void stop();
+    bool isStreaming() {return reader != nullptr;}
+
+    /* Stream statistics */
+    quint64 receivedBlocks() {return receivedCount.loadAcquire();}
+    quint64 droppedBlocks() {return droppedCount.loadAcquire();}
+    quint64 receivedBytes() {return receivedCount.loadAcquire() * (quint64)blockSize;}
+    double throughput();
+
+    QString errorString() {return errString;}
+
+signals:
+    void errorOccurred();
+
+private slots:
+    void on_readerError();
+
+private:
+    friend class FT232FifoReader;
+    friend class FT232FifoConsumer;
+
+    QPointer<FT232> device;
+    qint64 blockSize = 0;
+    BlockConsumer consumer;
+    FT232ChunkQueue *queue = nullptr;
+    FT232FifoReader *reader = nullptr;
+    FT232FifoConsumer *consumerThread = nullptr;
+
+    /* Consumer wakeup */
+    QMutex mutex;
+    QWaitCondition dataCondition;
+
+    QAtomicInt stopRequested;
+    QAtomicInteger<quint64> receivedCount;
+    QAtomicInteger<quint64> droppedCount;
+    QElapsedTimer clock;
+    qint64 streamNsecs = 0;
+
+    QString errString;
+};
+
+
+/* Synchronous bit-bang streaming
+ *
+ * In bit mode 0x04 every byte written drives the output
+ * pins for one clock, and the pins are sampled into one
+ * byte read back: the pattern and the sampled input are
+ * byte streams of the same length.
+ *
+ * start() switches the handle opened by FT232::open() to
+ * synchronous bit-bang and starts a worker thread which
+ * keeps two chunks of pattern queued in the driver: the
+ * next chunk is generated while the device still clocks
+ * out the current one, so it does not starve as long as
+ * the generator keeps up. When it does not, the device
+ * idles between chunks and underruns() is incremented.
+ *
+ * The sampled input is kept as one contiguous stream,
+ * read with readSamples() after samplesReady(). Once the
+ * generator runs out the stream stops by itself, emits
+ * finished() and the device is back in UART mode. A device
+ * taking no pattern for the write timeout of the FT232
+ * stops it the same way with errorOccurred().
+ */
+class FT232BitBangStream : public QObject
+{
+    Q_OBJECT
+
+public:
+    /* Called on the worker thread to fill up to size bytes of
+     * pattern, returns how many were written, 0 at the end
+     */
+    typedef std::function<qint64(char *data, qint64 size)> PatternGenerator;
+
+    FT232BitBangStream(FT232 *device, QObject *parent = nullptr);
+    virtual ~FT232BitBangStream();
+
+    bool start(quint8 outputMask, int sampleRate, const PatternGenerator &generator,
+               qint64 chunkSize = FTDI_BITBANG_CHUNK);
+    bool start(quint8 outputMask, int sampleRate, const QByteArray &pattern,
+               qint64 chunkSize = FTDI_BITBANG_CHUNK);
+    void stop();
+    bool isStreaming() {return worker != nullptr;}
+
+    /* Sampled input */
+    qint64 samplesAvailable();
+    QByteArray readSamples(qint64 maxSize = -1);
+
+    /* Stream statistics */
+    quint64 writtenSamples() {return writtenCount.loadAcquire();}
+    quint64 sampledSamples() {return sampledCount.loadAcquire();}
+    quint64 underruns() {return underrunCount.loadAcquire();}
+    double sampleRate();
+
+    QString errorString() {return errString;}
+
+signals:
+    void samplesReady();
+    void finished();
+    void errorOccurred();
+
+private slots:
+    void on_workerProgress();
+
+private:
+    friend class FT232BitBangWorker;
+
+    QPointer<FT232> device;
+    qint64 chunkSize = 0;
+    PatternGenerator generator;
+    FT232BitBangWorker *worker = nullptr;
+
+    /* Sampled input, filled by the worker */
+    QMutex samplesMutex;
+    FT232RingBuffer samples;
+
+    QAtomicInt stopRequested;
+    QAtomicInt notifyPending;
+    QAtomicInt workerDone;
+    QAtomicInt workerFailed;
+    QAtomicInteger<quint64> writtenCount;
+    QAtomicInteger<quint64> sampledCount;
+    QAtomicInteger<quint64> underrunCount;
+    QElapsedTimer clock;
+    qint64 streamNsecs = 0;
+
+    QString errString;
+};
+
+
+#endif // QFT2XXSTREAM_H
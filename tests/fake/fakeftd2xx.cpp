@@ -0,0 +1,820 @@
+/* Fake FTD2XX backend for the tests
+ *
+ * In-memory implementation of the FT_* functions used by
+ * the wrapper, see fakeftd2xx.h
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <dlfcn.h>
+#include <string.h>
+
+#include "fakeftd2xx.h"
+
+/* Receive queue storage reserved up front, so that
+ * steady-state receiving does not allocate
+ */
+static constexpr int FAKE_RX_CAPACITY   =   1 << 20;
+static constexpr DWORD FAKE_DEVICE_ID   =   0x04036001;
+/* Period of the driver thread signaling the event */
+static constexpr int FAKE_DRIVER_PERIOD_USECS   =   20;
+/* Synchronous bit-bang clocks one byte per period of
+ * 16 times the baud rate
+ */
+static constexpr int FAKE_BITBANG_CLOCK_FACTOR  =   16;
+/* Samples clocked in are not notified, FT_Read() waiting
+ * for them looks again after this
+ */
+static constexpr auto FAKE_CLOCK_POLL   =   std::chrono::milliseconds(1);
+
+/* Condition variable of the armed event handle, kept out
+ * of Device for the pthread_cond_destroy() hook, which
+ * also runs for Qt's own condition variables at exit
+ */
+static std::atomic<pthread_cond_t *> armedCond(nullptr);
+static std::atomic<int> destroyedArmed(0);
+
+static std::atomic<bool> driverRunning(false);
+static std::thread driverThread;
+
+namespace {
+
+struct Device {
+    std::mutex mutex;
+    FT_DEVICE type = FT_DEVICE_232R;
+    bool open = false;
+    UCHAR bitMode = FT_BITMODE_RESET;
+    FakeFtdi::Settings settings = {};
+
+    /* Wakes FT_Read() waiting for bytes */
+    std::condition_variable rxArrived;
+    QByteArray rx;
+    QByteArray written;
+    /* Writes of the bytes above, timed from reset() */
+    QVector<FakeFtdi::Write> writeLog;
+    std::chrono::steady_clock::time_point epoch;
+    /* Synchronous bit-bang pattern not clocked out yet,
+     * and when the last byte taken from it was
+     */
+    QByteArray clocking;
+    std::chrono::steady_clock::time_point clockedUntil;
+    /* Bytes written in UART mode come back as received */
+    bool loopback = false;
+    /* Stalled FT_Write() calls wait on writeResumed */
+    bool writeStalled = false;
+    std::condition_variable writeResumed;
+    DWORD events = 0;
+    ULONG modemStatus = 0;
+    bool rts = false;
+
+    EVENT_HANDLE *eventHandle = nullptr;
+    DWORD eventMask = 0;
+
+    FakeFtdi::Calls calls = {};
+    int sequence = 0;
+
+    /* MPSSE engine: commands split across writes wait
+     * in mpssePending until they are complete
+     */
+    QByteArray mpssePending;
+    QByteArray readData;
+    QByteArray readBits;
+    QByteArray lowPins;
+    FakeFtdi::Mpsse mpsse = {};
+};
+
+Device &device()
+{
+    static Device d;
+    return d;
+}
+
+/* Wake up whoever waits on the event handle,
+ * called with the device mutex held
+ */
+void signalEvent(Device &d, DWORD event)
+{
+    if (!d.eventHandle || !(d.eventMask & event))
+        return;
+
+    pthread_mutex_lock(&d.eventHandle->eMutex);
+    pthread_cond_signal(&d.eventHandle->eCondVar);
+    pthread_mutex_unlock(&d.eventHandle->eMutex);
+}
+
+/* Bytes arriving on the line, called with
+ * the device mutex held
+ */
+void arrive(Device &d, const char *data, qint64 len)
+{
+    d.rx.append(data, len);
+    d.events |= FT_EVENT_RXCHAR;
+    signalEvent(d, FT_EVENT_RXCHAR);
+    d.rxArrived.notify_all();
+}
+
+/* Clock out the synchronous bit-bang pattern at the
+ * programmed rate, sampling every byte back (the outputs
+ * loop back to the inputs). An idle device does not save
+ * up time. Called with the device mutex held
+ */
+void clockBitBang(Device &d)
+{
+    auto now = std::chrono::steady_clock::now();
+
+    if (d.clocking.isEmpty()) {
+        d.clockedUntil = now;
+        return;
+    }
+
+    double rate = double(d.settings.baudRate) * FAKE_BITBANG_CLOCK_FACTOR;
+    qint64 due = std::chrono::duration<double>(now - d.clockedUntil).count() * rate;
+    int n = (int)qMin(due, (qint64)d.clocking.size());
+    if (n <= 0)
+        return;
+
+    d.rx.append(d.clocking.constData(), n);
+    d.clocking.remove(0, n);
+    d.clockedUntil += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(n / rate));
+}
+
+/* Input of reads without output
+ */
+uchar nextReadByte(Device &d)
+{
+    if (d.readData.isEmpty())
+        return 0xFF;
+
+    uchar byte = d.readData.at(0);
+    d.readData.remove(0, 1);
+    return byte;
+}
+
+uchar nextReadBit(Device &d)
+{
+    if (d.readBits.isEmpty())
+        return 0;
+
+    uchar bit = d.readBits.at(0) ? 1 : 0;
+    d.readBits.remove(0, 1);
+    return bit;
+}
+
+void reply(Device &d, uchar byte)
+{
+    d.rx.append((char)byte);
+    d.mpsse.replyBytes++;
+}
+
+/* Decode and run one MPSSE command. Returns its length,
+ * 0 if it is not complete yet
+ *
+ * Data commands (below 0x80): bit 1 bit mode, bit 3 LSB
+ * first, bit 4 data out, bit 5 data in, bit 6 TMS out
+ */
+int runCommand(Device &d, const uchar *c, int avail)
+{
+    uchar op = c[0];
+
+    if (op < 0x80) {
+        bool tms = op & 0x40;
+        bool out = (op & 0x10) || tms;
+        bool in = op & 0x20;
+        bool lsbFirst = op & 0x08;
+
+        if (op & 0x02) {
+            int need = out ? 3 : 2;
+            if (avail < need)
+                return 0;
+
+            int bits = c[1] + 1;
+            uchar data = out ? c[2] : 0;
+            uchar shift = 0;
+
+            /* TMS commands put TDI on bit 7 */
+            for (int i = 0; i < bits; i++) {
+                uchar level = tms ? (data >> 7) & 1
+                                  : lsbFirst ? (data >> i) & 1 : (data >> (7 - i)) & 1;
+                if (!out)
+                    level = nextReadBit(d);
+                shift = lsbFirst ? (shift >> 1) | (level << 7) : (shift << 1) | level;
+            }
+            if (in)
+                reply(d, shift);
+            return need;
+        }
+
+        if (avail < 3)
+            return 0;
+        int len = (c[1] | (c[2] << 8)) + 1;
+        int need = 3 + ((op & 0x10) ? len : 0);
+        if (avail < need)
+            return 0;
+
+        if (in) {
+            for (int i = 0; i < len; i++)
+                reply(d, (op & 0x10) ? c[3 + i] : nextReadByte(d));
+        }
+        return need;
+    }
+
+    switch (op) {
+    case 0x80:
+        if (avail < 3)
+            return 0;
+        d.lowPins.append((char)c[1]);
+        return 3;
+    case 0x82:
+    case 0x86:
+    case 0x8F:
+    case 0x9E:
+        return avail < 3 ? 0 : 3;
+    case 0x8E:
+        return avail < 2 ? 0 : 2;
+    case 0x81:
+        reply(d, d.lowPins.isEmpty() ? 0 : d.lowPins.at(d.lowPins.size() - 1));
+        return 1;
+    case 0x83:
+        reply(d, 0);
+        return 1;
+    case 0x84:
+    case 0x85:
+    case 0x87:
+    case 0x8A:
+    case 0x8B:
+    case 0x8C:
+    case 0x8D:
+    case 0x96:
+    case 0x97:
+        return 1;
+    default:
+        /* Bad command: 0xFA and the command */
+        reply(d, 0xFA);
+        reply(d, op);
+        return 1;
+    }
+}
+
+void runMpsse(Device &d, const char *data, DWORD len)
+{
+    d.mpssePending.append(data, len);
+    d.mpsse.writes++;
+
+    const uchar *c = (const uchar *)d.mpssePending.constData();
+    int avail = d.mpssePending.size();
+    int done = 0;
+
+    while (done < avail) {
+        int n = runCommand(d, c + done, avail - done);
+        if (n == 0)
+            break;
+        done += n;
+    }
+    d.mpssePending.remove(0, done);
+    d.mpsse.commandBytes += done;
+}
+
+/* Driver side events: the armed event is signaled
+ * until stopDriverEvents()
+ */
+void driverEvents()
+{
+    Device &d = device();
+
+    while (driverRunning.load()) {
+        {
+            std::lock_guard<std::mutex> lock(d.mutex);
+            signalEvent(d, d.eventMask);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(FAKE_DRIVER_PERIOD_USECS));
+    }
+}
+
+}
+
+
+/* An event handle must not go away while the driver may
+ * still signal it: count those destroyed while armed
+ */
+extern "C" int pthread_cond_destroy(pthread_cond_t *cond) noexcept
+{
+    typedef int (*Destroy)(pthread_cond_t *);
+    static Destroy next = (Destroy)dlsym(RTLD_NEXT, "pthread_cond_destroy");
+
+    if (cond && cond == armedCond.load())
+        destroyedArmed++;
+    return next(cond);
+}
+
+
+/* Control side
+ */
+void FakeFtdi::reset()
+{
+    stopDriverEvents();
+
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.type = FT_DEVICE_232R;
+    d.bitMode = FT_BITMODE_RESET;
+    d.rx.clear();
+    d.rx.reserve(FAKE_RX_CAPACITY);
+    d.written.clear();
+    d.writeLog.clear();
+    d.epoch = std::chrono::steady_clock::now();
+    d.clocking.clear();
+    d.loopback = false;
+    d.writeStalled = false;
+    d.events = 0;
+    d.modemStatus = 0;
+    d.rts = false;
+    d.calls = Calls();
+    d.sequence = 0;
+    d.mpssePending.clear();
+    d.readData.clear();
+    d.readBits.clear();
+    d.lowPins.clear();
+    d.mpsse = Mpsse();
+    destroyedArmed = 0;
+}
+
+void FakeFtdi::setDeviceType(FT_DEVICE type)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.type = type;
+}
+
+void FakeFtdi::receive(const char *data, qint64 len)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    arrive(d, data, len);
+}
+
+void FakeFtdi::receive(const QByteArray &data)
+{
+    receive(data.constData(), data.size());
+}
+
+qint64 FakeFtdi::queuedBytes()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    return d.rx.size();
+}
+
+void FakeFtdi::setEvents(DWORD events)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.events |= events;
+    signalEvent(d, events);
+}
+
+void FakeFtdi::clearEvents()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.events = 0;
+}
+
+void FakeFtdi::setModemStatus(ULONG status)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.modemStatus = status;
+}
+
+FakeFtdi::Settings FakeFtdi::settings()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    return d.settings;
+}
+
+bool FakeFtdi::requestToSend()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    return d.rts;
+}
+
+QByteArray FakeFtdi::takeWritten()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    QByteArray written = d.written;
+    d.written.clear();
+    return written;
+}
+
+QVector<FakeFtdi::Write> FakeFtdi::takeWriteLog()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    QVector<Write> log = d.writeLog;
+    d.writeLog.clear();
+    return log;
+}
+
+void FakeFtdi::setLoopback(bool enable)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.loopback = enable;
+}
+
+void FakeFtdi::setWriteStalled(bool stalled)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.writeStalled = stalled;
+    d.writeResumed.notify_all();
+}
+
+FakeFtdi::Calls FakeFtdi::calls()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    return d.calls;
+}
+
+void FakeFtdi::queueReadData(const QByteArray &data)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.readData.append(data);
+}
+
+void FakeFtdi::queueReadBits(const QByteArray &levels)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.readBits.append(levels);
+}
+
+QByteArray FakeFtdi::takeLowPins()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    QByteArray pins = d.lowPins;
+    d.lowPins.clear();
+    return pins;
+}
+
+FakeFtdi::Mpsse FakeFtdi::mpsse()
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    return d.mpsse;
+}
+
+void FakeFtdi::startDriverEvents()
+{
+    if (driverRunning.exchange(true))
+        return;
+
+    driverThread = std::thread(driverEvents);
+}
+
+void FakeFtdi::stopDriverEvents()
+{
+    if (!driverRunning.exchange(false))
+        return;
+
+    driverThread.join();
+}
+
+int FakeFtdi::destroyedArmedEvents()
+{
+    return destroyedArmed.load();
+}
+
+
+/* Enumeration and identification
+ */
+FT_STATUS FT_CreateDeviceInfoList(LPDWORD lpdwNumDevs)
+{
+    *lpdwNumDevs = 1;
+    return FT_OK;
+}
+
+FT_STATUS FT_GetDeviceInfoList(FT_DEVICE_LIST_INFO_NODE *pDest, LPDWORD lpdwNumDevs)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    if (*lpdwNumDevs < 1)
+        return FT_INVALID_PARAMETER;
+
+    memset(pDest, 0, sizeof(*pDest));
+    pDest->Type = d.type;
+    pDest->ID = FAKE_DEVICE_ID;
+    strcpy(pDest->SerialNumber, "FAKE0001");
+    strcpy(pDest->Description, "Fake FT232");
+    *lpdwNumDevs = 1;
+    return FT_OK;
+}
+
+FT_STATUS FT_Open(int deviceNumber, FT_HANDLE *pHandle)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    if (deviceNumber != 0)
+        return FT_DEVICE_NOT_FOUND;
+
+    d.open = true;
+    d.bitMode = FT_BITMODE_RESET;
+    d.settings = FakeFtdi::Settings();
+    *pHandle = &d;
+    return FT_OK;
+}
+
+FT_STATUS FT_Close(FT_HANDLE ftHandle)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    if (ftHandle != &d || !d.open)
+        return FT_INVALID_HANDLE;
+
+    d.open = false;
+    d.eventHandle = nullptr;
+    d.eventMask = 0;
+    armedCond = nullptr;
+    d.rxArrived.notify_all();
+    d.writeResumed.notify_all();
+    return FT_OK;
+}
+
+FT_STATUS FT_GetDeviceInfo(FT_HANDLE, FT_DEVICE *lpftDevice, LPDWORD lpdwID,
+                           PCHAR SerialNumber, PCHAR Description, LPVOID)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    *lpftDevice = d.type;
+    *lpdwID = FAKE_DEVICE_ID;
+    if (SerialNumber)
+        strcpy(SerialNumber, "FAKE0001");
+    if (Description)
+        strcpy(Description, "Fake FT232");
+    return FT_OK;
+}
+
+FT_STATUS FT_EE_Read(FT_HANDLE, FT_PROGRAM_DATA *pData)
+{
+    strcpy(pData->Manufacturer, "FTDI");
+    strcpy(pData->ManufacturerId, "FT");
+    strcpy(pData->Description, "Fake FT232");
+    strcpy(pData->SerialNumber, "FAKE0001");
+    return FT_OK;
+}
+
+FT_STATUS FT_GetLibraryVersion(LPDWORD lpdwVersion)
+{
+    *lpdwVersion = 0x00010426;
+    return FT_OK;
+}
+
+
+/* Settings, those read back by settings() are kept,
+ * the others accepted and ignored
+ */
+FT_STATUS FT_SetBaudRate(FT_HANDLE, ULONG BaudRate)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.settings.baudRate = BaudRate;
+    return FT_OK;
+}
+
+FT_STATUS FT_SetDataCharacteristics(FT_HANDLE, UCHAR, UCHAR, UCHAR) {return FT_OK;}
+
+FT_STATUS FT_SetFlowControl(FT_HANDLE, USHORT FlowControl, UCHAR, UCHAR)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.settings.flowControl = FlowControl;
+    return FT_OK;
+}
+
+FT_STATUS FT_SetLatencyTimer(FT_HANDLE, UCHAR ucLatency)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.settings.latencyTimer = ucLatency;
+    return FT_OK;
+}
+
+FT_STATUS FT_SetTimeouts(FT_HANDLE, ULONG ReadTimeout, ULONG WriteTimeout)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.settings.readTimeout = ReadTimeout;
+    d.settings.writeTimeout = WriteTimeout;
+    return FT_OK;
+}
+
+FT_STATUS FT_SetUSBParameters(FT_HANDLE, ULONG ulInTransferSize, ULONG ulOutTransferSize)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.settings.inTransferSize = ulInTransferSize;
+    d.settings.outTransferSize = ulOutTransferSize;
+    return FT_OK;
+}
+
+FT_STATUS FT_SetChars(FT_HANDLE, UCHAR, UCHAR, UCHAR, UCHAR) {return FT_OK;}
+FT_STATUS FT_SetDtr(FT_HANDLE) {return FT_OK;}
+FT_STATUS FT_ClrDtr(FT_HANDLE) {return FT_OK;}
+FT_STATUS FT_SetRts(FT_HANDLE)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.rts = true;
+    return FT_OK;
+}
+
+FT_STATUS FT_ClrRts(FT_HANDLE)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.rts = false;
+    return FT_OK;
+}
+
+FT_STATUS FT_SetBitMode(FT_HANDLE, UCHAR ucMask, UCHAR ucEnable)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.bitMode = ucEnable;
+    d.settings.bitMode = ucEnable;
+    d.settings.bitModeMask = ucMask;
+    d.mpssePending.clear();
+    d.clocking.clear();
+    return FT_OK;
+}
+
+FT_STATUS FT_GetModemStatus(FT_HANDLE, ULONG *pModemStatus)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.calls.getModemStatus++;
+    *pModemStatus = d.modemStatus;
+    return FT_OK;
+}
+
+
+/* Events and data
+ */
+FT_STATUS FT_SetEventNotification(FT_HANDLE, DWORD Mask, PVOID Param)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.eventHandle = (EVENT_HANDLE *)Param;
+    d.eventMask = Mask;
+    armedCond = Mask && Param ? &d.eventHandle->eCondVar : nullptr;
+    return FT_OK;
+}
+
+FT_STATUS FT_GetStatus(FT_HANDLE, DWORD *dwRxBytes, DWORD *dwTxBytes, DWORD *dwEventDWord)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    d.calls.getStatus++;
+    clockBitBang(d);
+    *dwRxBytes = d.rx.size();
+    *dwTxBytes = 0;
+    *dwEventDWord = d.events;
+    d.events = 0;
+    return FT_OK;
+}
+
+FT_STATUS FT_GetQueueStatus(FT_HANDLE, DWORD *dwRxBytes)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    clockBitBang(d);
+    *dwRxBytes = d.rx.size();
+    return FT_OK;
+}
+
+/* Waits up to the read timeout for the requested bytes,
+ * then returns what is queued, like the driver
+ */
+FT_STATUS FT_Read(FT_HANDLE, LPVOID lpBuffer, DWORD dwBytesToRead, LPDWORD lpBytesReturned)
+{
+    Device &d = device();
+    std::unique_lock<std::mutex> lock(d.mutex);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(d.settings.readTimeout);
+
+    clockBitBang(d);
+    while ((DWORD)d.rx.size() < dwBytesToRead && d.open) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+            break;
+
+        d.rxArrived.wait_until(lock, d.clocking.isEmpty() ? deadline : std::min(deadline, now + FAKE_CLOCK_POLL));
+        clockBitBang(d);
+    }
+
+    DWORD n = qMin(dwBytesToRead, (DWORD)d.rx.size());
+    memcpy(lpBuffer, d.rx.constData(), n);
+    d.rx.remove(0, n);
+    *lpBytesReturned = n;
+
+    d.calls.read++;
+    d.calls.lastRead = ++d.sequence;
+    return FT_OK;
+}
+
+/* A stalled device takes nothing, the driver gives
+ * up after the write timeout
+ */
+FT_STATUS FT_Write(FT_HANDLE, LPVOID lpBuffer, DWORD dwBytesToWrite, LPDWORD lpBytesWritten)
+{
+    Device &d = device();
+    std::unique_lock<std::mutex> lock(d.mutex);
+
+    d.calls.write++;
+    if (d.writeStalled) {
+        d.writeResumed.wait_for(lock, std::chrono::milliseconds(d.settings.writeTimeout), [&]() {
+            return !d.writeStalled || !d.open;
+        });
+        if (d.writeStalled) {
+            *lpBytesWritten = 0;
+            return FT_OK;
+        }
+    }
+
+    if (d.bitMode == FT_BITMODE_MPSSE)
+        runMpsse(d, (const char *)lpBuffer, dwBytesToWrite);
+    else if (d.bitMode == FT_BITMODE_SYNC_BITBANG) {
+        clockBitBang(d);
+        d.clocking.append((const char *)lpBuffer, dwBytesToWrite);
+    }
+    else if (d.loopback)
+        arrive(d, (const char *)lpBuffer, dwBytesToWrite);
+    else {
+        auto since = std::chrono::steady_clock::now() - d.epoch;
+        d.written.append((const char *)lpBuffer, dwBytesToWrite);
+        d.writeLog.append({std::chrono::duration_cast<std::chrono::microseconds>(since).count(),
+                           (qint64)dwBytesToWrite});
+    }
+    *lpBytesWritten = dwBytesToWrite;
+    return FT_OK;
+}
+
+FT_STATUS FT_Purge(FT_HANDLE, ULONG Mask)
+{
+    Device &d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+
+    if (Mask & FT_PURGE_RX)
+        d.rx.resize(0);
+    if (Mask & FT_PURGE_TX)
+        d.clocking.clear();
+
+    d.calls.purge++;
+    d.calls.lastPurge = ++d.sequence;
+    return FT_OK;
+}
@@ -0,0 +1,121 @@
+#ifndef FAKEFTD2XX_H
+#define FAKEFTD2XX_H
+
+/* Control side of the fake FTD2XX backend
+ *
+ * There is a single fake device (VID 0403, PID 6001) behind
+ * all handles. Tests make bytes arrive on its line and set
+ * pending events and modem status; the FT_* functions then
+ * answer like the driver would, FT_Read() waiting up to the
+ * read timeout for its bytes. Calls are counted, with the
+ * order of the last FT_Read and FT_Purge kept for checking
+ * how a dispatch pass was sequenced.
+ *
+ * In MPSSE mode written commands are decoded and answered
+ * like the engine would: data clocked out is looped back to
+ * the input (DO to DI, TDI to TDO), reads without output take
+ * their input from queueReadData() and queueReadBits().
+ *
+ * In synchronous bit-bang mode written bytes are clocked
+ * out at 16 times the baud rate and each one is read back
+ * as its sample once clocked.
+ *
+ * Nothing here allocates once the device buffers have grown,
+ * so the backend can sit under an allocation counter.
+ */
+
+#include <QByteArray>
+#include <QVector>
+
+#include "ftd2xx.h"
+
+namespace FakeFtdi {
+
+struct Calls {
+    int getStatus;
+    int getModemStatus;
+    int read;
+    int purge;
+    /* FT_Write calls, stalled ones included */
+    int write;
+    /* Sequence numbers of the last FT_Read and FT_Purge */
+    int lastRead;
+    int lastPurge;
+};
+
+struct Settings {
+    /* Programmed with the FT_Set* functions */
+    ULONG baudRate;
+    UCHAR latencyTimer;
+    USHORT flowControl;
+    ULONG readTimeout;
+    ULONG writeTimeout;
+    ULONG inTransferSize;
+    ULONG outTransferSize;
+    UCHAR bitMode;
+    UCHAR bitModeMask;
+};
+
+struct Write {
+    /* Time since reset() and bytes taken by one FT_Write() */
+    qint64 usecs;
+    qint64 bytes;
+};
+
+struct Mpsse {
+    /* FT_Write calls and bytes decoded in MPSSE mode */
+    int writes;
+    qint64 commandBytes;
+    qint64 replyBytes;
+};
+
+void reset();
+void setDeviceType(FT_DEVICE type);
+
+/* Bytes arriving on the line, they raise FT_EVENT_RXCHAR */
+void receive(const char *data, qint64 len);
+void receive(const QByteArray &data);
+qint64 queuedBytes();
+
+/* Pending event bits, cleared by FT_GetStatus() */
+void setEvents(DWORD events);
+void clearEvents();
+void setModemStatus(ULONG status);
+Settings settings();
+/* Level of the RTS line */
+bool requestToSend();
+
+/* Bytes written in UART mode, and the writes they took */
+QByteArray takeWritten();
+QVector<Write> takeWriteLog();
+/* TX wired to RX: bytes written in UART mode are received */
+void setLoopback(bool enable);
+/* A stalled device takes no bytes, FT_Write() returns
+ * none after the write timeout
+ */
+void setWriteStalled(bool stalled);
+
+Calls calls();
+
+/* MPSSE input of byte reads (default 0xFF) and of bit reads
+ * (one level per byte, default 0), used up in order
+ */
+void queueReadData(const QByteArray &data);
+void queueReadBits(const QByteArray &levels);
+/* Values of ADBUS0..7 set by the low pins commands, in order */
+QByteArray takeLowPins();
+Mpsse mpsse();
+
+/* A driver thread signaling the armed event over and over,
+ * like data streaming in while the port is being closed
+ */
+void startDriverEvents();
+void stopDriverEvents();
+/* Event handles destroyed while the driver could still
+ * signal them (pthread_cond_destroy() is hooked)
+ */
+int destroyedArmedEvents();
+
+}
+
+#endif // FAKEFTD2XX_H
@@ -0,0 +1,139 @@
+#ifndef FAKE_FTD2XX_H
+#define FAKE_FTD2XX_H
+
+/* Fake FTD2XX header for the tests
+ *
+ * Declares the part of the FTD2XX API used by the wrapper,
+ * implemented by fakeftd2xx.cpp on an in-memory device.
+ * Linux flavour: events are signaled through EVENT_HANDLE
+ */
+
+#include <pthread.h>
+
+typedef unsigned int DWORD;
+typedef unsigned long ULONG;
+typedef unsigned short USHORT;
+typedef unsigned short WORD;
+typedef unsigned char UCHAR;
+typedef void *PVOID;
+typedef void *LPVOID;
+typedef DWORD *LPDWORD;
+typedef char *PCHAR;
+
+typedef PVOID FT_HANDLE;
+typedef ULONG FT_STATUS;
+typedef ULONG FT_DEVICE;
+
+typedef struct {
+    pthread_cond_t eCondVar;
+    pthread_mutex_t eMutex;
+    int iVar;
+} EVENT_HANDLE;
+
+enum {
+    FT_OK,
+    FT_INVALID_HANDLE,
+    FT_DEVICE_NOT_FOUND,
+    FT_DEVICE_NOT_OPENED,
+    FT_IO_ERROR,
+    FT_INSUFFICIENT_RESOURCES,
+    FT_INVALID_PARAMETER,
+    FT_INVALID_BAUD_RATE
+};
+
+enum {
+    FT_DEVICE_BM,
+    FT_DEVICE_AM,
+    FT_DEVICE_100AX,
+    FT_DEVICE_UNKNOWN,
+    FT_DEVICE_2232C,
+    FT_DEVICE_232R,
+    FT_DEVICE_2232H,
+    FT_DEVICE_4232H,
+    FT_DEVICE_232H,
+    FT_DEVICE_X_SERIES
+};
+
+#define FT_BITS_8               (UCHAR)8
+#define FT_BITS_7               (UCHAR)7
+#define FT_STOP_BITS_1          (UCHAR)0
+#define FT_STOP_BITS_2          (UCHAR)2
+#define FT_PARITY_NONE          (UCHAR)0
+#define FT_PARITY_ODD           (UCHAR)1
+#define FT_PARITY_EVEN          (UCHAR)2
+#define FT_PARITY_MARK          (UCHAR)3
+#define FT_PARITY_SPACE         (UCHAR)4
+
+#define FT_FLOW_NONE            0x0000
+#define FT_FLOW_RTS_CTS         0x0100
+#define FT_FLOW_DTR_DSR         0x0200
+#define FT_FLOW_XON_XOFF        0x0400
+
+#define FT_PURGE_RX             1
+#define FT_PURGE_TX             2
+
+#define FT_EVENT_RXCHAR         1
+#define FT_EVENT_MODEM_STATUS   2
+#define FT_EVENT_LINE_STATUS    4
+
+#define FT_BITMODE_RESET        0x00
+#define FT_BITMODE_ASYNC_BITBANG 0x01
+#define FT_BITMODE_MPSSE        0x02
+#define FT_BITMODE_SYNC_BITBANG 0x04
+#define FT_BITMODE_SYNC_FIFO    0x40
+
+typedef struct {
+    ULONG Flags;
+    ULONG Type;
+    ULONG ID;
+    DWORD LocId;
+    char SerialNumber[16];
+    char Description[64];
+    FT_HANDLE ftHandle;
+} FT_DEVICE_LIST_INFO_NODE;
+
+typedef struct {
+    DWORD Signature1;
+    DWORD Signature2;
+    DWORD Version;
+    WORD VendorId;
+    WORD ProductId;
+    char *Manufacturer;
+    char *ManufacturerId;
+    char *Description;
+    char *SerialNumber;
+} FT_PROGRAM_DATA;
+
+FT_STATUS FT_CreateDeviceInfoList(LPDWORD lpdwNumDevs);
+FT_STATUS FT_GetDeviceInfoList(FT_DEVICE_LIST_INFO_NODE *pDest, LPDWORD lpdwNumDevs);
+FT_STATUS FT_Open(int deviceNumber, FT_HANDLE *pHandle);
+FT_STATUS FT_Close(FT_HANDLE ftHandle);
+FT_STATUS FT_GetDeviceInfo(FT_HANDLE ftHandle, FT_DEVICE *lpftDevice, LPDWORD lpdwID,
+                           PCHAR SerialNumber, PCHAR Description, LPVOID Dummy);
+FT_STATUS FT_EE_Read(FT_HANDLE ftHandle, FT_PROGRAM_DATA *pData);
+FT_STATUS FT_GetLibraryVersion(LPDWORD lpdwVersion);
+
+FT_STATUS FT_SetBaudRate(FT_HANDLE ftHandle, ULONG BaudRate);
+FT_STATUS FT_SetDataCharacteristics(FT_HANDLE ftHandle, UCHAR WordLength, UCHAR StopBits, UCHAR Parity);
+FT_STATUS FT_SetFlowControl(FT_HANDLE ftHandle, USHORT FlowControl, UCHAR XonChar, UCHAR XoffChar);
+FT_STATUS FT_SetLatencyTimer(FT_HANDLE ftHandle, UCHAR ucLatency);
+FT_STATUS FT_SetTimeouts(FT_HANDLE ftHandle, ULONG ReadTimeout, ULONG WriteTimeout);
+FT_STATUS FT_SetUSBParameters(FT_HANDLE ftHandle, ULONG ulInTransferSize, ULONG ulOutTransferSize);
+FT_STATUS FT_SetChars(FT_HANDLE ftHandle, UCHAR EventChar, UCHAR EventCharEnabled,
+                      UCHAR ErrorChar, UCHAR ErrorCharEnabled);
+FT_STATUS FT_SetBitMode(FT_HANDLE ftHandle, UCHAR ucMask, UCHAR ucEnable);
+
+FT_STATUS FT_SetDtr(FT_HANDLE ftHandle);
+FT_STATUS FT_ClrDtr(FT_HANDLE ftHandle);
+FT_STATUS FT_SetRts(FT_HANDLE ftHandle);
+FT_STATUS FT_ClrRts(FT_HANDLE ftHandle);
+FT_STATUS FT_GetModemStatus(FT_HANDLE ftHandle, ULONG *pModemStatus);
+
+FT_STATUS FT_SetEventNotification(FT_HANDLE ftHandle, DWORD Mask, PVOID Param);
+FT_STATUS FT_GetStatus(FT_HANDLE ftHandle, DWORD *dwRxBytes, DWORD *dwTxBytes, DWORD *dwEventDWord);
+FT_STATUS FT_GetQueueStatus(FT_HANDLE ftHandle, DWORD *dwRxBytes);
+FT_STATUS FT_Read(FT_HANDLE ftHandle, LPVOID lpBuffer, DWORD dwBytesToRead, LPDWORD lpBytesReturned);
+FT_STATUS FT_Write(FT_HANDLE ftHandle, LPVOID lpBuffer, DWORD dwBytesToWrite, LPDWORD lpBytesWritten);
+FT_STATUS FT_Purge(FT_HANDLE ftHandle, ULONG Mask);
+
+#endif // FAKE_FTD2XX_H
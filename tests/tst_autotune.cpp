@@ -0,0 +1,151 @@
+/* Transfer size auto-tune over the fake loopback:
+ * throughput of a few points, every point bounded in
+ * time, the device let go between points and the
+ * settings in use restored
+ *
+ */
+
+#include <QtTest>
+
+#include <atomic>
+#include <thread>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Streaming time of each point */
+static constexpr int POINT_MSECS        =   50;
+/* Drain and scheduling slack allowed per point */
+static constexpr int POINT_SLACK_MSECS  =   50;
+
+class AutoTuneTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void throughput_data();
+    void throughput();
+    void pointsBoundedInTime();
+    void deviceFreeBetweenPoints();
+    void settingsRestored();
+
+private:
+    FT232 *device = nullptr;
+};
+
+void AutoTuneTest::init()
+{
+    FakeFtdi::reset();
+    FakeFtdi::setLoopback(true);
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void AutoTuneTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+void AutoTuneTest::throughput_data()
+{
+    QTest::addColumn<int>("inSize");
+
+    QTest::newRow("4 KiB") << 4096;
+    QTest::newRow("16 KiB") << 16384;
+    QTest::newRow("64 KiB") << 65536;
+}
+
+/* One point per transfer size, the pattern comes back intact
+ */
+void AutoTuneTest::throughput()
+{
+    QFETCH(int, inSize);
+    QList<FT232::TransferTuning> results;
+
+    QBENCHMARK {
+        results = device->autoTuneTransferSize({inSize}, {FTDI_LATENCY_MIN}, POINT_MSECS);
+    }
+
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results.first().inTransferSize, inSize);
+    QVERIFY(results.first().verified);
+    QVERIFY(results.first().bytesPerSecond > 0);
+
+    qInfo("%d bytes per transfer: %.1f MB/s, %.2f CPU ns/byte", inSize,
+          results.first().bytesPerSecond / 1e6, results.first().cpuNsecsPerByte);
+}
+
+/* However fast the loopback, a point lasts its time
+ * and not until a byte count went through
+ */
+void AutoTuneTest::pointsBoundedInTime()
+{
+    QList<int> inSizes = {4096, 65536};
+    QList<int> latencies = {2, 16};
+    QElapsedTimer timer;
+
+    timer.start();
+    QList<FT232::TransferTuning> results = device->autoTuneTransferSize(inSizes, latencies, POINT_MSECS);
+    qint64 elapsed = timer.elapsed();
+
+    QCOMPARE(results.size(), inSizes.size() * latencies.size());
+    QVERIFY(elapsed >= results.size() * POINT_MSECS);
+    QVERIFY(elapsed < results.size() * (POINT_MSECS + POINT_SLACK_MSECS));
+}
+
+/* ftdiMutex is held for one point at a time: another
+ * thread reading the modem status gets in between points,
+ * instead of waiting for the whole sweep
+ */
+void AutoTuneTest::deviceFreeBetweenPoints()
+{
+    QList<int> latencies = {2, 3, 4, 8, 12, 16};
+    std::atomic<bool> done(false);
+    std::atomic<qint64> longest(0);
+    QElapsedTimer sweep;
+
+    std::thread other([&]() {
+        while (!done.load()) {
+            QElapsedTimer timer;
+            timer.start();
+            device->pinoutSignals();
+            longest = qMax(longest.load(), timer.elapsed());
+        }
+    });
+
+    sweep.start();
+    QList<FT232::TransferTuning> results = device->autoTuneTransferSize({4096}, latencies, POINT_MSECS);
+    qint64 elapsed = sweep.elapsed();
+    done = true;
+    other.join();
+
+    QCOMPARE(results.size(), latencies.size());
+    QVERIFY2(longest.load() < elapsed / 2,
+             qPrintable(QString("waited %1 of %2 ms").arg(longest.load()).arg(elapsed)));
+}
+
+/* The sweep changes transfer size and latency timer,
+ * the ones in use are back afterwards
+ */
+void AutoTuneTest::settingsRestored()
+{
+    QVERIFY(device->setUsbTransferSize(8192, 8192));
+    FakeFtdi::Settings before = FakeFtdi::settings();
+
+    QVERIFY(!device->autoTuneTransferSize({4096, 65536}, {2, 16}, POINT_MSECS).isEmpty());
+
+    FakeFtdi::Settings after = FakeFtdi::settings();
+    QCOMPARE(after.inTransferSize, before.inTransferSize);
+    QCOMPARE(after.outTransferSize, before.outTransferSize);
+    QCOMPARE(after.latencyTimer, before.latencyTimer);
+    QCOMPARE(FakeFtdi::queuedBytes(), qint64(0));
+}
+
+QTEST_GUILESS_MAIN(AutoTuneTest)
+
+#include "tst_autotune.moc"
@@ -0,0 +1,116 @@
+/* RTS backpressure without flow control
+ *
+ * While the bounded receive buffer is above its high
+ * watermark RTS is held low, whatever path would raise it
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Receive buffer of the tests, high watermark at 3/4 */
+static constexpr qint64 BUFFER_SIZE     =   64;
+
+class BackpressureTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void heldWhileThrottled();
+    void heldThroughApplySettings();
+    void offByDefault();
+
+private:
+    void fillBuffer();
+    void drainBuffer();
+
+    FT232 *device = nullptr;
+};
+
+void BackpressureTest::init()
+{
+    FakeFtdi::reset();
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+    device->setReadBufferSize(BUFFER_SIZE);
+}
+
+void BackpressureTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+void BackpressureTest::fillBuffer()
+{
+    FakeFtdi::receive(QByteArray(BUFFER_SIZE, 'f'));
+    device->on_FTDIevent();
+}
+
+void BackpressureTest::drainBuffer()
+{
+    device->readAll();
+}
+
+/* RTS drops above the high watermark and goes back to
+ * the application's state once drained
+ */
+void BackpressureTest::heldWhileThrottled()
+{
+    device->setRtsBackpressure(true);
+    QVERIFY(device->setRequestToSend(true));
+    QVERIFY(FakeFtdi::requestToSend());
+
+    fillBuffer();
+    QVERIFY(!FakeFtdi::requestToSend());
+
+    /* Only remembered while held */
+    QVERIFY(device->setRequestToSend(true));
+    QVERIFY(!FakeFtdi::requestToSend());
+
+    drainBuffer();
+    QVERIFY(FakeFtdi::requestToSend());
+}
+
+/* applySettings() must not raise a held RTS
+ */
+void BackpressureTest::heldThroughApplySettings()
+{
+    device->setRtsBackpressure(true);
+    QVERIFY(device->setRequestToSend(false));
+
+    fillBuffer();
+    QVERIFY(!FakeFtdi::requestToSend());
+
+    FT232Settings settings = device->settings();
+    settings.requestToSend = true;
+    QVERIFY(device->applySettings(settings));
+    QVERIFY(device->isRequestToSend());
+    QVERIFY(!FakeFtdi::requestToSend());
+
+    drainBuffer();
+    QVERIFY(FakeFtdi::requestToSend());
+}
+
+/* Not enabled: RTS belongs to the application
+ */
+void BackpressureTest::offByDefault()
+{
+    QVERIFY(device->setRequestToSend(true));
+
+    fillBuffer();
+    QVERIFY(FakeFtdi::requestToSend());
+
+    drainBuffer();
+    QVERIFY(FakeFtdi::requestToSend());
+}
+
+QTEST_GUILESS_MAIN(BackpressureTest)
+
+#include "tst_backpressure.moc"
@@ -0,0 +1,126 @@
+/* Buffered write: bytesWritten() totals reported through
+ * the event loop, and close() sending what is queued or,
+ * once the device takes nothing, giving up within the
+ * write timeout
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Writes queued by the totals test */
+static constexpr int QUEUED_WRITES      =   50;
+/* Write timeout of the stalled device test, and what
+ * close() may take beyond it (one driver write slice
+ * and scheduling)
+ */
+static constexpr int STALL_TIMEOUT      =   200;
+static constexpr int STALL_SLACK_MSECS  =   100;
+
+class BufferedWriteTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void bytesWrittenTotals();
+    void closeDrainsQueue();
+    void closeAbortsStalled();
+
+private:
+    QByteArray queueWrites();
+
+    FT232 *device = nullptr;
+};
+
+void BufferedWriteTest::init()
+{
+    FakeFtdi::reset();
+    device = new FT232();
+    device->setPort();
+    device->setBufferedWrite(true);
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void BufferedWriteTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* Queue writes of growing size, returns all of their bytes
+ */
+QByteArray BufferedWriteTest::queueWrites()
+{
+    QByteArray all;
+
+    for (int i = 0; i < QUEUED_WRITES; i++) {
+        QByteArray data(i + 1, char('a' + i % 26));
+        if (device->write(data) != data.size())
+            return QByteArray();
+        all.append(data);
+    }
+
+    return all;
+}
+
+/* bytesWritten() adds up to what was queued, and the
+ * device got it in order
+ */
+void BufferedWriteTest::bytesWrittenTotals()
+{
+    qint64 reported = 0;
+
+    connect(device, &QIODevice::bytesWritten, this, [&](qint64 bytes) {
+        reported += bytes;
+    });
+
+    QByteArray all = queueWrites();
+    QVERIFY(!all.isEmpty());
+
+    QTRY_COMPARE(reported, qint64(all.size()));
+    QCOMPARE(device->bytesToWrite(), qint64(0));
+    QCOMPARE(FakeFtdi::takeWritten(), all);
+}
+
+/* close() sends what is still queued
+ */
+void BufferedWriteTest::closeDrainsQueue()
+{
+    QByteArray all = queueWrites();
+    QVERIFY(!all.isEmpty());
+
+    device->close();
+
+    QVERIFY(!device->isOpen());
+    QCOMPARE(FakeFtdi::takeWritten(), all);
+}
+
+/* A device taking nothing: close() drops the queue after
+ * the write timeout instead of waiting forever
+ */
+void BufferedWriteTest::closeAbortsStalled()
+{
+    QElapsedTimer timer;
+
+    QVERIFY(device->setWriteTimeout(STALL_TIMEOUT));
+    FakeFtdi::setWriteStalled(true);
+    QVERIFY(!queueWrites().isEmpty());
+
+    timer.start();
+    device->close();
+    qint64 elapsed = timer.elapsed();
+
+    QVERIFY(!device->isOpen());
+    QVERIFY2(elapsed < STALL_TIMEOUT + STALL_SLACK_MSECS,
+             qPrintable(QString("close() took %1 ms").arg(elapsed)));
+    QVERIFY(FakeFtdi::takeWritten().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(BufferedWriteTest)
+
+#include "tst_bufferedwrite.moc"
@@ -0,0 +1,164 @@
+/* Event dispatch of the FT232 receive path
+ *
+ * The fake backend raises RXCHAR and MODEM_STATUS together:
+ * one on_FTDIevent() pass must deliver the data and handle
+ * the modem status, without waiting for another event
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Modem status with an overrun error, a serious
+ * error on which the device queue is purged
+ */
+static constexpr ULONG MODEM_OVERRUN    =   0x0200;
+/* Chunk received per wakeup by the latency benchmark */
+static constexpr int LATENCY_CHUNK      =   64;
+/* Time the driver keeps signaling before the port closes */
+static constexpr int SIGNALING_MSECS    =   20;
+
+class EventDispatchTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void combinedEvents();
+    void dataBeforePurge();
+    void modemStatusWithData();
+    void deliveryLatency();
+    void closeWhileSignaled_data();
+    void closeWhileSignaled();
+
+private:
+    FT232 *device = nullptr;
+};
+
+void EventDispatchTest::init()
+{
+    FakeFtdi::reset();
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void EventDispatchTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* Both bits set: data and modem status in one pass
+ */
+void EventDispatchTest::combinedEvents()
+{
+    QSignalSpy readyRead(device, &QIODevice::readyRead);
+    FakeFtdi::Calls before = FakeFtdi::calls();
+
+    FakeFtdi::receive(QByteArray("hello"));
+    FakeFtdi::setEvents(FT_EVENT_MODEM_STATUS);
+    device->on_FTDIevent();
+
+    FakeFtdi::Calls after = FakeFtdi::calls();
+    QCOMPARE(readyRead.count(), 1);
+    QCOMPARE(device->bytesAvailable(), qint64(5));
+    QCOMPARE(device->readAll(), QByteArray("hello"));
+    QCOMPARE(after.getStatus - before.getStatus, 1);
+    QCOMPARE(after.getModemStatus - before.getModemStatus, 1);
+}
+
+/* A serious modem error purges the device: the data
+ * of the same pass must have been read before
+ */
+void EventDispatchTest::dataBeforePurge()
+{
+    FakeFtdi::receive(QByteArray("payload"));
+    FakeFtdi::setModemStatus(MODEM_OVERRUN);
+    FakeFtdi::setEvents(FT_EVENT_MODEM_STATUS);
+    device->on_FTDIevent();
+
+    FakeFtdi::Calls calls = FakeFtdi::calls();
+    QCOMPARE(device->readAll(), QByteArray("payload"));
+    QVERIFY(calls.lastPurge > calls.lastRead);
+}
+
+/* Only MODEM_STATUS signaled, but bytes are waiting:
+ * they are received anyway
+ */
+void EventDispatchTest::modemStatusWithData()
+{
+    FakeFtdi::receive(QByteArray("late"));
+    FakeFtdi::clearEvents();
+    FakeFtdi::setEvents(FT_EVENT_MODEM_STATUS);
+    device->on_FTDIevent();
+
+    QCOMPARE(device->readAll(), QByteArray("late"));
+}
+
+/* Cost of one combined wakeup, from the event to the
+ * data being readable after readyRead()
+ */
+void EventDispatchTest::deliveryLatency()
+{
+    QByteArray chunk(LATENCY_CHUNK, 'x');
+    char buffer[LATENCY_CHUNK];
+    int delivered = 0;
+
+    connect(device, &QIODevice::readyRead, this, [&]() {
+        delivered += device->read(buffer, sizeof(buffer));
+    });
+
+    QBENCHMARK {
+        FakeFtdi::receive(chunk);
+        FakeFtdi::setEvents(FT_EVENT_MODEM_STATUS);
+        device->on_FTDIevent();
+        QCOMPARE(delivered, LATENCY_CHUNK);
+        delivered = 0;
+    }
+}
+
+void EventDispatchTest::closeWhileSignaled_data()
+{
+    QTest::addColumn<bool>("threaded");
+    QTest::addColumn<bool>("destroy");
+
+    QTest::newRow("notify only, close") << false << false;
+    QTest::newRow("notify only, destructor") << false << true;
+    QTest::newRow("threaded, close") << true << false;
+    QTest::newRow("threaded, destructor") << true << true;
+}
+
+/* The driver keeps signaling the event while the port
+ * closes: it must be disarmed before the event is gone
+ */
+void EventDispatchTest::closeWhileSignaled()
+{
+    QFETCH(bool, threaded);
+    QFETCH(bool, destroy);
+
+    device->close();
+    device->setThreadedReceive(threaded);
+    QVERIFY(device->open(QIODevice::ReadWrite));
+
+    FakeFtdi::startDriverEvents();
+    QTest::qWait(SIGNALING_MSECS);
+
+    if (destroy) {
+        delete device;
+        device = nullptr;
+    }
+    else
+        device->close();
+    FakeFtdi::stopDriverEvents();
+
+    QCOMPARE(FakeFtdi::destroyedArmedEvents(), 0);
+}
+
+QTEST_GUILESS_MAIN(EventDispatchTest)
+
+#include "tst_eventdispatch.moc"
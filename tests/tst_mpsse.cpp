@@ -0,0 +1,371 @@
+/* MPSSE engines against the simulated MPSSE of the fake
+ * backend: SPI transactions and batch throughput, I2C ACK
+ * handling, JTAG shifts and TAP walks
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "qft2xxmpsse.h"
+#include "fakeftd2xx.h"
+
+/* SPI clock of the tests (Hz) */
+static constexpr int SPI_CLOCK          =   10000000;
+/* Bytes clocked by each benchmark transaction */
+static constexpr int SPI_BENCH_BYTES    =   4;
+/* I2C clock of the tests (Hz) */
+static constexpr int I2C_CLOCK          =   400000;
+/* ACK levels sampled on SDA */
+static constexpr char I2C_ACK           =   0;
+static constexpr char I2C_NACK          =   1;
+/* JTAG clock of the tests (Hz) */
+static constexpr int JTAG_CLOCK         =   6000000;
+
+class MpsseTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void spiTransfer();
+    void spiWriteRead();
+    void spiOneWritePerBatch();
+    void spiThroughput_data();
+    void spiThroughput();
+
+    void i2cWrite();
+    void i2cNackPosition();
+    void i2cAddressNack();
+    void i2cPushPull();
+    void i2cOneWritePerBatch();
+
+    void jtagShift_data();
+    void jtagShift();
+    void jtagTapState();
+    void jtagOneWritePerFlush();
+    void jtagLargeBatch();
+
+private:
+    FT232 *device = nullptr;
+};
+
+void MpsseTest::init()
+{
+    FakeFtdi::reset();
+    FakeFtdi::setDeviceType(FT_DEVICE_232H);
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void MpsseTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* Full duplex: MISO is looped back from MOSI, chip
+ * select is asserted around the transaction only
+ */
+void MpsseTest::spiTransfer()
+{
+    FT232Spi spi(device);
+    QVERIFY2(spi.begin(SPI_CLOCK, 0, 3), qPrintable(spi.errorString()));
+    FakeFtdi::takeLowPins();
+
+    QByteArray data("\x9F\x01\x02", 3);
+    int t = spi.transfer(data);
+    QVERIFY(spi.execute());
+
+    QCOMPARE(spi.result(t), data);
+    QCOMPARE(FakeFtdi::takeLowPins(), QByteArray("\x00\x08", 2));
+}
+
+/* Write then read: read bytes come from the device,
+ * transactions keep their own results
+ */
+void MpsseTest::spiWriteRead()
+{
+    FT232Spi spi(device);
+    QVERIFY(spi.begin(SPI_CLOCK));
+
+    FakeFtdi::queueReadData(QByteArray("\xDE\xAD\xBE\xEF", 4));
+    int first = spi.writeRead(QByteArray("\x03", 1), 2);
+    int second = spi.write(QByteArray("\x06", 1));
+    int third = spi.writeRead(QByteArray("\x05", 1), 2);
+    QVERIFY(spi.execute());
+
+    QCOMPARE(spi.result(first), QByteArray("\xDE\xAD", 2));
+    QCOMPARE(spi.result(second), QByteArray());
+    QCOMPARE(spi.result(third), QByteArray("\xBE\xEF", 2));
+    QCOMPARE(spi.executedTransactions(), quint64(3));
+}
+
+/* A whole batch is one FT_Write
+ */
+void MpsseTest::spiOneWritePerBatch()
+{
+    FT232Spi spi(device);
+    QVERIFY(spi.begin(SPI_CLOCK));
+
+    for (int i = 0; i < 40; i++)
+        spi.transfer(QByteArray(SPI_BENCH_BYTES, char(i)));
+
+    FakeFtdi::Mpsse before = FakeFtdi::mpsse();
+    QVERIFY(spi.execute());
+    FakeFtdi::Mpsse after = FakeFtdi::mpsse();
+
+    QCOMPARE(after.writes - before.writes, 1);
+    QCOMPARE(after.replyBytes - before.replyBytes, qint64(40 * SPI_BENCH_BYTES));
+    for (int i = 0; i < 40; i++)
+        QCOMPARE(spi.result(i), QByteArray(SPI_BENCH_BYTES, char(i)));
+}
+
+void MpsseTest::spiThroughput_data()
+{
+    QTest::addColumn<int>("batch");
+
+    QTest::newRow("1 per batch") << 1;
+    QTest::newRow("10 per batch") << 10;
+    QTest::newRow("100 per batch") << 100;
+    QTest::newRow("1000 per batch") << 1000;
+}
+
+/* Transactions per second the batching reaches, with the
+ * USB round trip taken out by the simulated backend
+ */
+void MpsseTest::spiThroughput()
+{
+    QFETCH(int, batch);
+    FT232Spi spi(device);
+    QByteArray data(SPI_BENCH_BYTES, 0x5A);
+
+    QVERIFY(spi.begin(SPI_CLOCK));
+
+    QBENCHMARK {
+        for (int i = 0; i < batch; i++)
+            spi.transfer(data);
+        QVERIFY(spi.execute());
+    }
+
+    qInfo("%d transactions per batch: %.0f transactions/s", batch, spi.transactionsPerSecond());
+}
+
+/* Every byte acknowledged: the transaction succeeds
+ */
+void MpsseTest::i2cWrite()
+{
+    FT232I2c i2c(device);
+    QVERIFY2(i2c.begin(I2C_CLOCK), qPrintable(i2c.errorString()));
+
+    int t = i2c.write(0x50, QByteArray("\x00\x10\xAA", 3));
+    QVERIFY(i2c.execute());
+
+    QVERIFY(i2c.result(t).ok());
+    QCOMPARE(i2c.result(t).nackPosition, -1);
+    QCOMPARE(i2c.failedTransactions(), 0);
+}
+
+/* A NACK fails its own transaction at the byte that got
+ * it, the others of the batch keep their results
+ */
+void MpsseTest::i2cNackPosition()
+{
+    FT232I2c i2c(device);
+    QVERIFY(i2c.begin(I2C_CLOCK));
+
+    /* Address and one byte, address and two bytes with the
+     * last one refused, then a register read
+     */
+    const char acks[] = {I2C_ACK, I2C_ACK,
+                         I2C_ACK, I2C_ACK, I2C_NACK,
+                         I2C_ACK, I2C_ACK, I2C_ACK};
+    FakeFtdi::queueReadBits(QByteArray(acks, sizeof(acks)));
+    FakeFtdi::queueReadData(QByteArray("\x12\x34", 2));
+
+    int first = i2c.write(0x50, QByteArray("\x01", 1));
+    int second = i2c.write(0x51, QByteArray("\x02\x03", 2));
+    int third = i2c.writeRead(0x50, QByteArray("\x04", 1), 2);
+    QVERIFY(i2c.execute());
+
+    QVERIFY(i2c.result(first).ok());
+    QCOMPARE(i2c.result(second).nackPosition, 2);
+    QVERIFY(i2c.result(second).data.isEmpty());
+    QVERIFY(i2c.result(third).ok());
+    QCOMPARE(i2c.result(third).data, QByteArray("\x12\x34", 2));
+    QCOMPARE(i2c.failedTransactions(), 1);
+}
+
+/* No device at the address: NACK on the address byte,
+ * no data returned
+ */
+void MpsseTest::i2cAddressNack()
+{
+    FT232I2c i2c(device);
+    QVERIFY(i2c.begin(I2C_CLOCK));
+
+    FakeFtdi::queueReadBits(QByteArray(1, I2C_NACK));
+    int t = i2c.read(0x20, 1);
+    QVERIFY(i2c.execute());
+
+    QCOMPARE(i2c.result(t).nackPosition, 0);
+    QVERIFY(i2c.result(t).data.isEmpty());
+}
+
+/* Chips without drive-zero mode encode the same
+ * transactions without it
+ */
+void MpsseTest::i2cPushPull()
+{
+    delete device;
+    FakeFtdi::reset();
+    FakeFtdi::setDeviceType(FT_DEVICE_2232H);
+    device = new FT232();
+    device->setPort();
+    QVERIFY(device->open(QIODevice::ReadWrite));
+
+    FT232I2c i2c(device);
+    QVERIFY2(i2c.begin(I2C_CLOCK), qPrintable(i2c.errorString()));
+
+    FakeFtdi::queueReadData(QByteArray("\x5A", 1));
+    int t = i2c.writeRead(0x50, QByteArray("\x00", 1), 1);
+    QVERIFY(i2c.execute());
+
+    QVERIFY(i2c.result(t).ok());
+    QCOMPARE(i2c.result(t).data, QByteArray("\x5A", 1));
+}
+
+/* A whole batch is one FT_Write, the reply holds an
+ * ACK sample per written byte
+ */
+void MpsseTest::i2cOneWritePerBatch()
+{
+    FT232I2c i2c(device);
+    QVERIFY(i2c.begin(I2C_CLOCK));
+
+    for (int i = 0; i < 20; i++)
+        i2c.write(0x50, QByteArray(2, char(i)));
+
+    FakeFtdi::Mpsse before = FakeFtdi::mpsse();
+    QVERIFY(i2c.execute());
+    FakeFtdi::Mpsse after = FakeFtdi::mpsse();
+
+    QCOMPARE(after.writes - before.writes, 1);
+    QCOMPARE(after.replyBytes - before.replyBytes, qint64(20 * 3));
+    QCOMPARE(i2c.failedTransactions(), 0);
+    QCOMPARE(i2c.executedTransactions(), quint64(20));
+}
+
+void MpsseTest::jtagShift_data()
+{
+    QTest::addColumn<bool>("ir");
+    QTest::addColumn<QByteArray>("tdi");
+    QTest::addColumn<int>("bits");
+    QTest::addColumn<QByteArray>("tdo");
+
+    QTest::newRow("IR 1 bit") << true << QByteArray("\x01", 1) << 1 << QByteArray("\x01", 1);
+    QTest::newRow("IR 5 bits") << true << QByteArray("\xFF", 1) << 5 << QByteArray("\x1F", 1);
+    QTest::newRow("DR 8 bits") << false << QByteArray("\xA5", 1) << 8 << QByteArray("\xA5", 1);
+    QTest::newRow("DR 13 bits") << false << QByteArray("\xFF\xFF", 2) << 13 << QByteArray("\xFF\x1F", 2);
+    QTest::newRow("DR 32 bits") << false << QByteArray("\xEF\xBE\xAD\xDE", 4) << 32
+                                << QByteArray("\xEF\xBE\xAD\xDE", 4);
+}
+
+/* TDO is looped back from TDI: a captured shift reads
+ * back its own bits, those past the length are zeros
+ */
+void MpsseTest::jtagShift()
+{
+    QFETCH(bool, ir);
+    QFETCH(QByteArray, tdi);
+    QFETCH(int, bits);
+    QFETCH(QByteArray, tdo);
+    FT232Jtag jtag(device);
+
+    QVERIFY2(jtag.begin(JTAG_CLOCK), qPrintable(jtag.errorString()));
+
+    int shift = ir ? jtag.shiftIr(tdi, bits, true) : jtag.shiftDr(tdi, bits, true);
+    QVERIFY(shift >= 0);
+    QVERIFY(jtag.flush());
+
+    QCOMPARE(jtag.tdo(shift), tdo);
+}
+
+/* Shifts leave the TAP in their end state, walks go
+ * where they are told
+ */
+void MpsseTest::jtagTapState()
+{
+    FT232Jtag jtag(device);
+    QVERIFY(jtag.begin(JTAG_CLOCK));
+    QCOMPARE(jtag.state(), FT232Jtag::RunTestIdle);
+
+    jtag.shiftIr(QByteArray("\x0A", 1), 4, false, FT232Jtag::PauseIr);
+    QCOMPARE(jtag.state(), FT232Jtag::PauseIr);
+
+    int shift = jtag.shiftDr(QByteArray("\x3C", 1), 8, true, FT232Jtag::PauseDr);
+    QCOMPARE(jtag.state(), FT232Jtag::PauseDr);
+
+    jtag.goToState(FT232Jtag::UpdateIr);
+    QCOMPARE(jtag.state(), FT232Jtag::UpdateIr);
+
+    jtag.reset();
+    QCOMPARE(jtag.state(), FT232Jtag::RunTestIdle);
+
+    QVERIFY(jtag.flush());
+    QCOMPARE(jtag.tdo(shift), QByteArray("\x3C", 1));
+}
+
+/* Shifts are only encoded until flush(), which sends
+ * them all with one FT_Write
+ */
+void MpsseTest::jtagOneWritePerFlush()
+{
+    FT232Jtag jtag(device);
+    QVERIFY(jtag.begin(JTAG_CLOCK));
+
+    FakeFtdi::Mpsse before = FakeFtdi::mpsse();
+    int first = jtag.shiftIr(QByteArray("\x02", 1), 4, false);
+    int second = jtag.shiftDr(QByteArray("\x34\x12", 2), 16, true);
+    jtag.runTest(100);
+    int third = jtag.shiftDr(QByteArray("\x07", 1), 3, true);
+    QCOMPARE(jtag.pendingShifts(), 3);
+    QCOMPARE(FakeFtdi::mpsse().writes, before.writes);
+
+    QVERIFY(jtag.flush());
+    FakeFtdi::Mpsse after = FakeFtdi::mpsse();
+
+    QCOMPARE(after.writes - before.writes, 1);
+    QCOMPARE(jtag.pendingShifts(), 0);
+    QCOMPARE(jtag.tdo(first), QByteArray());
+    QCOMPARE(jtag.tdo(second), QByteArray("\x34\x12", 2));
+    QCOMPARE(jtag.tdo(third), QByteArray("\x07", 1));
+}
+
+/* Past the reply limit the queued shifts are sent on
+ * their own, TDO of all of them is still returned
+ */
+void MpsseTest::jtagLargeBatch()
+{
+    FT232Jtag jtag(device);
+    QVERIFY(jtag.begin(JTAG_CLOCK));
+
+    const int bytes = 512;
+    const int count = int(FTDI_JTAG_MAX_REPLY / bytes) + 8;
+
+    FakeFtdi::Mpsse before = FakeFtdi::mpsse();
+    for (int i = 0; i < count; i++)
+        jtag.shiftDr(QByteArray(bytes, char(i)), bytes * 8, true);
+    QVERIFY(FakeFtdi::mpsse().writes > before.writes);
+
+    QVERIFY(jtag.flush());
+    for (int i = 0; i < count; i++)
+        QCOMPARE(jtag.tdo(i), QByteArray(bytes, char(i)));
+}
+
+QTEST_GUILESS_MAIN(MpsseTest)
+
+#include "tst_mpsse.moc"
@@ -0,0 +1,135 @@
+/* Transmit pacing: the byte rate seen by the device
+ * follows the configured rate, and no run of writes
+ * takes more than the token bucket allows
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Allowed deviation of the observed rate (percent) */
+static constexpr int RATE_TOLERANCE     =   10;
+/* Scheduling jitter allowed to the bucket check (us) */
+static constexpr qint64 JITTER_USECS    =   2000;
+
+class PacingTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void followsRate_data();
+    void followsRate();
+    void burstsWithinBucket_data();
+    void burstsWithinBucket();
+
+private:
+    QVector<FakeFtdi::Write> pacedWrites(qint64 rate, qint64 burst, qint64 bytes);
+
+    FT232 *device = nullptr;
+};
+
+void PacingTest::init()
+{
+    FakeFtdi::reset();
+    device = new FT232();
+    device->setPort();
+    device->setBufferedWrite(true);
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void PacingTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* Write bytes at rate with the given bucket size, returns
+ * the FT_Write() calls the device saw
+ */
+QVector<FakeFtdi::Write> PacingTest::pacedWrites(qint64 rate, qint64 burst, qint64 bytes)
+{
+    QByteArray data(bytes, 'p');
+
+    device->setTransmitPacing(rate, burst);
+    if (device->write(data) != bytes)
+        return QVector<FakeFtdi::Write>();
+
+    QElapsedTimer timer;
+    timer.start();
+    while (device->bytesToWrite() > 0 && timer.elapsed() < 4 * bytes * 1000 / rate)
+        QTest::qWait(10);
+
+    if (FakeFtdi::takeWritten() != data)
+        return QVector<FakeFtdi::Write>();
+
+    return FakeFtdi::takeWriteLog();
+}
+
+void PacingTest::followsRate_data()
+{
+    QTest::addColumn<qint64>("rate");
+    QTest::addColumn<qint64>("burst");
+
+    QTest::newRow("20 kB/s, 64 byte bucket") << qint64(20000) << qint64(64);
+    QTest::newRow("100 kB/s, 1 KiB bucket") << qint64(100000) << qint64(1024);
+    QTest::newRow("1 MB/s, 4 KiB bucket") << qint64(1000000) << qint64(4096);
+}
+
+/* The first write empties the full bucket, the rest
+ * goes out at the configured rate
+ */
+void PacingTest::followsRate()
+{
+    QFETCH(qint64, rate);
+    QFETCH(qint64, burst);
+
+    QVector<FakeFtdi::Write> log = pacedWrites(rate, burst, rate / 4);
+    QVERIFY(log.size() > 1);
+
+    qint64 bytes = 0;
+    for (int i = 1; i < log.size(); i++)
+        bytes += log.at(i).bytes;
+
+    double observed = bytes * 1e6 / qMax(log.last().usecs - log.first().usecs, qint64(1));
+    QVERIFY2(qAbs(observed - rate) * 100 < rate * RATE_TOLERANCE,
+             qPrintable(QString("%1 bytes/s").arg(qint64(observed))));
+}
+
+void PacingTest::burstsWithinBucket_data()
+{
+    followsRate_data();
+}
+
+/* No write is larger than the bucket, and any run of
+ * writes took at most a bucket plus what the rate
+ * refilled over its duration
+ */
+void PacingTest::burstsWithinBucket()
+{
+    QFETCH(qint64, rate);
+    QFETCH(qint64, burst);
+
+    QVector<FakeFtdi::Write> log = pacedWrites(rate, burst, rate / 4);
+    QVERIFY(!log.isEmpty());
+
+    for (int i = 0; i < log.size(); i++) {
+        QVERIFY(log.at(i).bytes <= burst);
+
+        qint64 bytes = 0;
+        for (int j = i; j < log.size(); j++) {
+            bytes += log.at(j).bytes;
+            qint64 usecs = log.at(j).usecs - log.at(i).usecs + JITTER_USECS;
+            QVERIFY2(bytes <= burst + rate * usecs / 1000000,
+                     qPrintable(QString("%1 bytes in %2 us").arg(bytes).arg(usecs)));
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(PacingTest)
+
+#include "tst_pacing.moc"
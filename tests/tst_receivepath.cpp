@@ -0,0 +1,196 @@
+/* Receive path allocations
+ *
+ * Once the receive buffer has grown to the steady state
+ * traffic, an RXCHAR event must be read straight into it
+ * and handed to the reader without touching the heap.
+ * Global operator new/delete count what the test thread
+ * allocates while counting is switched on.
+ *
+ * Also what peek() returns outliving the buffer space
+ * it was taken from
+ *
+ */
+
+#include <QtTest>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Events received before counting starts, so every
+ * buffer on the path has reached its steady size
+ */
+static constexpr int WARMUP_EVENTS      =   64;
+/* Events received while counting */
+static constexpr int COUNTED_EVENTS     =   1000;
+/* Largest chunk of the tests */
+static constexpr int MAX_CHUNK          =   4096;
+
+static thread_local bool countAllocations = false;
+static std::atomic<quint64> allocations(0);
+
+static void *allocate(std::size_t size)
+{
+    if (countAllocations)
+        allocations++;
+
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(std::size_t size) {return allocate(size);}
+void *operator new[](std::size_t size) {return allocate(size);}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {return allocate(size);} catch (...) {return nullptr;}
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try {return allocate(size);} catch (...) {return nullptr;}
+}
+void operator delete(void *p) noexcept {std::free(p);}
+void operator delete[](void *p) noexcept {std::free(p);}
+void operator delete(void *p, std::size_t) noexcept {std::free(p);}
+void operator delete[](void *p, std::size_t) noexcept {std::free(p);}
+
+/* Counts the allocations of the calling thread
+ * during its lifetime
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter() : start(allocations.load()) {countAllocations = true;}
+    ~AllocationCounter() {countAllocations = false;}
+    quint64 count() const {return allocations.load() - start;}
+
+private:
+    quint64 start;
+};
+
+class ReceivePathTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void counterWorks();
+    void steadyState_data();
+    void steadyState();
+    void peekOwnsBytes();
+
+private:
+    void receiveOne(const QByteArray &chunk, bool event);
+
+    FT232 *device = nullptr;
+};
+
+void ReceivePathTest::init()
+{
+    FakeFtdi::reset();
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void ReceivePathTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* The counter sees the allocations of this thread
+ */
+void ReceivePathTest::counterWorks()
+{
+    quint64 counted;
+    {
+        AllocationCounter counter;
+        int *volatile p = new int(1);
+        delete p;
+        counted = counter.count();
+    }
+
+    QCOMPARE(counted, quint64(1));
+}
+
+/* Receive one chunk, through the event dispatch or
+ * the receive slot, and read it back
+ */
+void ReceivePathTest::receiveOne(const QByteArray &chunk, bool event)
+{
+    char buffer[MAX_CHUNK];
+
+    FakeFtdi::receive(chunk);
+    if (event)
+        device->on_FTDIevent();
+    else
+        device->on_FTDIreceive();
+    device->read(buffer, sizeof(buffer));
+}
+
+void ReceivePathTest::steadyState_data()
+{
+    QTest::addColumn<int>("chunk");
+    QTest::addColumn<bool>("event");
+
+    QTest::newRow("event, 1 byte") << 1 << true;
+    QTest::newRow("event, 64 bytes") << 64 << true;
+    QTest::newRow("event, 4096 bytes") << MAX_CHUNK << true;
+    QTest::newRow("receive, 64 bytes") << 64 << false;
+}
+
+/* No allocation per event once warmed up
+ */
+void ReceivePathTest::steadyState()
+{
+    QFETCH(int, chunk);
+    QFETCH(bool, event);
+    QByteArray data(chunk, 'r');
+    quint64 counted;
+
+    for (int i = 0; i < WARMUP_EVENTS; i++)
+        receiveOne(data, event);
+    QCOMPARE(device->bytesAvailable(), qint64(0));
+
+    {
+        AllocationCounter counter;
+        for (int i = 0; i < COUNTED_EVENTS; i++)
+            receiveOne(data, event);
+        counted = counter.count();
+    }
+
+    QCOMPARE(device->bytesAvailable(), qint64(0));
+    QCOMPARE(counted, quint64(0));
+}
+
+/* Bytes peeked stay valid once consumed and their
+ * buffer space is reused: the next chunk is as large as
+ * the buffer, so it wraps over them
+ */
+void ReceivePathTest::peekOwnsBytes()
+{
+    QByteArray next(FTDI_RX_BUFFER_SIZE, 'n');
+
+    FakeFtdi::receive(QByteArray("peek"));
+    device->on_FTDIevent();
+
+    QByteArray peeked = device->peek(4);
+    QCOMPARE(device->consume(4), qint64(4));
+
+    FakeFtdi::receive(next);
+    device->on_FTDIevent();
+
+    QCOMPARE(peeked, QByteArray("peek"));
+    QCOMPARE(device->readAll(), next);
+}
+
+QTEST_GUILESS_MAIN(ReceivePathTest)
+
+#include "tst_receivepath.moc"
@@ -0,0 +1,219 @@
+/* Receive ring buffer: ordering across wrap and growth,
+ * the cost of draining a backlog in small reads and of
+ * the byte accounting, size() seen from another thread
+ *
+ */
+
+#include <QtTest>
+#include <QSemaphore>
+
+#include <atomic>
+#include <thread>
+
+#include "qft2xx.h"
+
+/* Bytes taken by each read of the drain benchmark */
+static constexpr int DRAIN_READ_SIZE    =   64;
+/* Chunk received and read size of the read path benchmark */
+static constexpr int READ_PATH_CHUNK    =   512;
+static constexpr int READ_PATH_READ     =   8;
+/* Rounds of the concurrent size() test */
+static constexpr int SIZE_RACE_ROUNDS   =   200000;
+
+class RingBufferTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void wrapAround();
+    void growKeepsOrder();
+    void backlogDrain_data();
+    void backlogDrain();
+    void readPath_data();
+    void readPath();
+    void sizeFromOtherThread();
+};
+
+/* Byte i of a test stream */
+static char streamByte(quint64 i)
+{
+    return char((i * 7) ^ (i >> 8));
+}
+
+/* Reads and writes crossing the end of storage
+ * return the bytes in order
+ */
+void RingBufferTest::wrapAround()
+{
+    FT232RingBuffer ring(16);
+    char in[11], out[11];
+    quint64 written = 0, read = 0;
+
+    for (int round = 0; round < 50; round++) {
+        for (int i = 0; i < 11; i++)
+            in[i] = streamByte(written + i);
+        ring.append(in, sizeof(in));
+        written += sizeof(in);
+
+        qint64 n = ring.read(out, sizeof(out));
+        QCOMPARE(n, qint64(sizeof(out)));
+        for (int i = 0; i < n; i++)
+            QCOMPARE(out[i], streamByte(read + i));
+        read += n;
+    }
+
+    QCOMPARE(ring.capacity(), qint64(16));
+    QVERIFY(ring.isEmpty());
+}
+
+/* Growing while the data wraps keeps it in order
+ */
+void RingBufferTest::growKeepsOrder()
+{
+    FT232RingBuffer ring(16);
+    char data[40], out[40];
+
+    for (int i = 0; i < 40; i++)
+        data[i] = streamByte(i);
+
+    /* Move head and tail close to the end of storage */
+    ring.append(data, 12);
+    QCOMPARE(ring.read(out, 12), qint64(12));
+
+    ring.append(data, 10);
+    ring.append(data + 10, 30);
+    QCOMPARE(ring.capacity(), qint64(64));
+    QCOMPARE(ring.size(), qint64(40));
+
+    QCOMPARE(ring.read(out, sizeof(out)), qint64(40));
+    QCOMPARE(QByteArray(out, 40), QByteArray(data, 40));
+}
+
+void RingBufferTest::backlogDrain_data()
+{
+    QTest::addColumn<bool>("ring");
+    QTest::addColumn<int>("backlog");
+
+    QTest::newRow("QByteArray remove, 64 KiB") << false << (64 << 10);
+    QTest::newRow("ring buffer, 64 KiB") << true << (64 << 10);
+    QTest::newRow("QByteArray remove, 256 KiB") << false << (256 << 10);
+    QTest::newRow("ring buffer, 256 KiB") << true << (256 << 10);
+}
+
+/* Draining a backlog in small reads: the former front
+ * erasure of the QByteArray moves the rest of the backlog
+ * on every read (quadratic), the ring buffer does not
+ */
+void RingBufferTest::backlogDrain()
+{
+    QFETCH(bool, ring);
+    QFETCH(int, backlog);
+    QByteArray data(backlog, 'x');
+    char out[DRAIN_READ_SIZE];
+    qint64 drained = 0;
+
+    if (ring) {
+        FT232RingBuffer buffer(backlog);
+
+        QBENCHMARK {
+            buffer.append(data.constData(), data.size());
+            while (!buffer.isEmpty())
+                drained += buffer.read(out, sizeof(out));
+        }
+    }
+    else {
+        QByteArray buffer;
+
+        QBENCHMARK {
+            buffer.append(data);
+            while (!buffer.isEmpty()) {
+                qint64 n = qMin((qint64)sizeof(out), (qint64)buffer.size());
+                memcpy(out, buffer.constData(), n);
+                buffer.remove(0, n);
+                drained += n;
+            }
+        }
+    }
+
+    QVERIFY(drained > 0);
+    QCOMPARE(drained % backlog, qint64(0));
+}
+
+void RingBufferTest::readPath_data()
+{
+    QTest::addColumn<bool>("semaphore");
+
+    QTest::newRow("QSemaphore accounting") << true;
+    QTest::newRow("atomic indices") << false;
+}
+
+/* Many small reads of received chunks: the former
+ * QSemaphore counted every byte in and out again (a mutex
+ * per release and acquire), size() only loads two indices
+ */
+void RingBufferTest::readPath()
+{
+    QFETCH(bool, semaphore);
+    FT232RingBuffer buffer(READ_PATH_CHUNK);
+    QSemaphore sem;
+    char chunk[READ_PATH_CHUNK];
+    char out[READ_PATH_READ];
+    qint64 read = 0;
+
+    memset(chunk, 'r', sizeof(chunk));
+
+    if (semaphore) {
+        QBENCHMARK {
+            buffer.append(chunk, sizeof(chunk));
+            sem.release(sizeof(chunk));
+            while (sem.available() > 0) {
+                qint64 n = qMin((qint64)sizeof(out), (qint64)sem.available());
+                if (!sem.tryAcquire(n))
+                    break;
+                read += buffer.read(out, n);
+            }
+        }
+    }
+    else {
+        QBENCHMARK {
+            buffer.append(chunk, sizeof(chunk));
+            while (buffer.size() > 0)
+                read += buffer.read(out, sizeof(out));
+        }
+    }
+
+    QCOMPARE(read % READ_PATH_CHUNK, qint64(0));
+    QVERIFY(buffer.isEmpty());
+}
+
+/* size() polled from another thread while the owner
+ * appends and reads is never negative
+ */
+void RingBufferTest::sizeFromOtherThread()
+{
+    FT232RingBuffer buffer(64);
+    std::atomic<bool> done(false);
+    qint64 smallest = 0;
+    char data[7], out[5];
+
+    memset(data, 's', sizeof(data));
+
+    std::thread observer([&]() {
+        while (!done.load())
+            smallest = qMin(smallest, buffer.size());
+    });
+
+    for (int i = 0; i < SIZE_RACE_ROUNDS; i++) {
+        if (buffer.size() + (qint64)sizeof(data) <= buffer.capacity())
+            buffer.append(data, sizeof(data));
+        buffer.read(out, sizeof(out));
+    }
+    done = true;
+    observer.join();
+
+    QCOMPARE(smallest, qint64(0));
+}
+
+QTEST_GUILESS_MAIN(RingBufferTest)
+
+#include "tst_ringbuffer.moc"
@@ -0,0 +1,224 @@
+/* Streaming engines against the fake backend: FIFO block
+ * delivery and drops, UART mode restored after stop(),
+ * bit-bang samples, underruns and a stalled device
+ *
+ */
+
+#include <QtTest>
+#include <QSemaphore>
+
+#include "qft2xx.h"
+#include "qft2xxstream.h"
+#include "fakeftd2xx.h"
+
+/* Block size of the FIFO tests */
+static constexpr int FIFO_BLOCK         =   512;
+/* Blocks streamed by the FIFO tests */
+static constexpr int FIFO_BLOCKS        =   10;
+/* Bit-bang sample rate and chunk: 40 ms per chunk */
+static constexpr int BITBANG_RATE       =   25600;
+static constexpr int BITBANG_CHUNK      =   1024;
+static constexpr int BITBANG_CHUNKS     =   6;
+static constexpr int BITBANG_CHUNK_MSECS =  BITBANG_CHUNK * 1000 / BITBANG_RATE;
+/* Write timeout of the stalled device test */
+static constexpr int STALL_TIMEOUT      =   50;
+
+class StreamTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void fifoOrderedBlocks();
+    void fifoDropsWhenStalled();
+    void fifoRestoresSettings();
+    void bitBangSamples();
+    void bitBangUnderruns();
+    void bitBangWriteStall();
+
+private:
+    FT232 *device = nullptr;
+};
+
+/* Block n of a FIFO stream, starting with its number
+ */
+static QByteArray fifoBlock(int n)
+{
+    QByteArray block(FIFO_BLOCK, Qt::Uninitialized);
+
+    for (int i = 0; i < FIFO_BLOCK; i++)
+        block[i] = char(n + i);
+
+    return block;
+}
+
+void StreamTest::init()
+{
+    FakeFtdi::reset();
+    FakeFtdi::setDeviceType(FT_DEVICE_232H);
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void StreamTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* Blocks reach the consumer whole and in order, the
+ * queue has room for all of them so none is dropped
+ */
+void StreamTest::fifoOrderedBlocks()
+{
+    FT232FifoStream stream(device);
+    QList<QByteArray> blocks;
+    QMutex mutex;
+
+    QVERIFY2(stream.start(FIFO_BLOCK, [&](const char *data, qint64 size) {
+        QMutexLocker locker(&mutex);
+        blocks.append(QByteArray(data, size));
+    }, FIFO_BLOCKS), qPrintable(stream.errorString()));
+
+    for (int n = 0; n < FIFO_BLOCKS; n++)
+        FakeFtdi::receive(fifoBlock(n));
+
+    QTRY_COMPARE(stream.receivedBlocks(), quint64(FIFO_BLOCKS));
+    stream.stop();
+
+    QCOMPARE(stream.droppedBlocks(), quint64(0));
+    QCOMPARE(blocks.size(), FIFO_BLOCKS);
+    for (int n = 0; n < FIFO_BLOCKS; n++)
+        QCOMPARE(blocks.at(n), fifoBlock(n));
+}
+
+/* A stalled consumer holds one block and leaves the
+ * other slot to the reader: everything past them is
+ * drained from the chip and counted as dropped
+ */
+void StreamTest::fifoDropsWhenStalled()
+{
+    FT232FifoStream stream(device);
+    QSemaphore resume;
+    QList<int> delivered;
+
+    QVERIFY(stream.start(FIFO_BLOCK, [&](const char *data, qint64) {
+        resume.acquire();
+        delivered.append(uchar(data[0]));
+    }, 2));
+
+    for (int n = 0; n < FIFO_BLOCKS; n++)
+        FakeFtdi::receive(fifoBlock(n));
+
+    QTRY_COMPARE(stream.droppedBlocks(), quint64(FIFO_BLOCKS - 2));
+    QCOMPARE(FakeFtdi::queuedBytes(), qint64(0));
+
+    resume.release(FIFO_BLOCKS);
+    stream.stop();
+
+    QCOMPARE(stream.receivedBlocks(), quint64(2));
+    QCOMPARE(delivered, QList<int>() << 0 << 1);
+}
+
+/* stop() puts back UART mode and its settings, and
+ * hands received data to the UART path again
+ */
+void StreamTest::fifoRestoresSettings()
+{
+    FakeFtdi::Settings before = FakeFtdi::settings();
+    FT232FifoStream stream(device);
+
+    QVERIFY(stream.start(FIFO_BLOCK, [](const char *, qint64) {}));
+    QCOMPARE(FakeFtdi::settings().bitMode, UCHAR(FT_BITMODE_SYNC_FIFO));
+    QCOMPARE(FakeFtdi::settings().inTransferSize, ULONG(FTDI_USB_TRANSFER_MAX));
+
+    stream.stop();
+    QVERIFY(!stream.isStreaming());
+
+    FakeFtdi::Settings after = FakeFtdi::settings();
+    QCOMPARE(after.bitMode, UCHAR(FT_BITMODE_RESET));
+    QCOMPARE(after.baudRate, before.baudRate);
+    QCOMPARE(after.latencyTimer, before.latencyTimer);
+    QCOMPARE(after.flowControl, before.flowControl);
+    QCOMPARE(after.readTimeout, before.readTimeout);
+    QCOMPARE(after.writeTimeout, before.writeTimeout);
+    QCOMPARE(after.inTransferSize, ULONG(FTDI_USB_TRANSFER_DEFAULT));
+
+    FakeFtdi::receive(QByteArray("uart"));
+    device->on_FTDIevent();
+    QCOMPARE(device->readAll(), QByteArray("uart"));
+}
+
+/* One sample per pattern byte, the fake loops the
+ * outputs back. A generator keeping ahead of the
+ * clock never lets the device idle
+ */
+void StreamTest::bitBangSamples()
+{
+    FT232BitBangStream stream(device);
+    QSignalSpy finished(&stream, &FT232BitBangStream::finished);
+    QByteArray pattern(BITBANG_CHUNK * BITBANG_CHUNKS, Qt::Uninitialized);
+
+    for (int i = 0; i < pattern.size(); i++)
+        pattern[i] = char(i * 7);
+
+    QVERIFY2(stream.start(0xFF, BITBANG_RATE, pattern, BITBANG_CHUNK),
+             qPrintable(stream.errorString()));
+    QTRY_COMPARE(finished.count(), 1);
+
+    QCOMPARE(stream.writtenSamples(), quint64(pattern.size()));
+    QCOMPARE(stream.sampledSamples(), quint64(pattern.size()));
+    QCOMPARE(stream.readSamples(), pattern);
+    QCOMPARE(stream.underruns(), quint64(0));
+    QCOMPARE(FakeFtdi::settings().bitMode, UCHAR(FT_BITMODE_RESET));
+}
+
+/* A generator slower than the clock: every chunk after
+ * the first one finds the device idle
+ */
+void StreamTest::bitBangUnderruns()
+{
+    FT232BitBangStream stream(device);
+    QSignalSpy finished(&stream, &FT232BitBangStream::finished);
+    int chunks = 0;
+
+    QVERIFY(stream.start(0xFF, BITBANG_RATE, [&](char *data, qint64 size) -> qint64 {
+        if (chunks == BITBANG_CHUNKS)
+            return 0;
+        chunks++;
+        QThread::msleep(2 * BITBANG_CHUNK_MSECS);
+        memset(data, 0x55, size);
+        return size;
+    }, BITBANG_CHUNK));
+    QTRY_COMPARE_WITH_TIMEOUT(finished.count(), 1, 10000);
+
+    QCOMPARE(stream.sampledSamples(), quint64(BITBANG_CHUNK * BITBANG_CHUNKS));
+    QCOMPARE(stream.underruns(), quint64(BITBANG_CHUNKS - 1));
+}
+
+/* A device taking no pattern stops the stream with an
+ * error after the write timeout, instead of the worker
+ * retrying forever
+ */
+void StreamTest::bitBangWriteStall()
+{
+    FT232BitBangStream stream(device);
+    QSignalSpy errorOccurred(&stream, &FT232BitBangStream::errorOccurred);
+
+    QVERIFY(device->setWriteTimeout(STALL_TIMEOUT));
+    FakeFtdi::setWriteStalled(true);
+
+    QVERIFY(stream.start(0xFF, BITBANG_RATE, QByteArray(BITBANG_CHUNK, 'p'), BITBANG_CHUNK));
+    QTRY_COMPARE(errorOccurred.count(), 1);
+
+    QVERIFY(!stream.isStreaming());
+    QCOMPARE(stream.writtenSamples(), quint64(0));
+    QCOMPARE(FakeFtdi::settings().bitMode, UCHAR(FT_BITMODE_RESET));
+}
+
+QTEST_GUILESS_MAIN(StreamTest)
+
+#include "tst_stream.moc"
@@ -0,0 +1,92 @@
+/* Read and write timeouts: values round-trip to the
+ * driver, negative ones are rejected and change nothing
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+class TimeoutsTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void roundTrip();
+    void negativeRejected();
+    void negativeRejectedBySettings();
+
+private:
+    FT232 *device = nullptr;
+};
+
+void TimeoutsTest::init()
+{
+    FakeFtdi::reset();
+    device = new FT232();
+    device->setPort();
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void TimeoutsTest::cleanup()
+{
+    delete device;
+    device = nullptr;
+}
+
+/* What is set is read back and programmed in the driver
+ */
+void TimeoutsTest::roundTrip()
+{
+    QVERIFY(device->setReadTimeout(250));
+    QVERIFY(device->setWriteTimeout(750));
+
+    QCOMPARE(device->readTimeout(), 250);
+    QCOMPARE(device->writeTimeout(), 750);
+    QCOMPARE(FakeFtdi::settings().readTimeout, ULONG(250));
+    QCOMPARE(FakeFtdi::settings().writeTimeout, ULONG(750));
+
+    QVERIFY(device->setReadTimeout(0));
+    QCOMPARE(device->readTimeout(), 0);
+    QCOMPARE(FakeFtdi::settings().readTimeout, ULONG(0));
+}
+
+/* A negative timeout fails, the previous one stays
+ * in effect and the device stays open
+ */
+void TimeoutsTest::negativeRejected()
+{
+    QVERIFY(device->setReadTimeout(250));
+    QVERIFY(device->setWriteTimeout(750));
+
+    QVERIFY(!device->setReadTimeout(-1));
+    QVERIFY(!device->setWriteTimeout(-1));
+
+    QCOMPARE(device->readTimeout(), 250);
+    QCOMPARE(device->writeTimeout(), 750);
+    QCOMPARE(FakeFtdi::settings().readTimeout, ULONG(250));
+    QCOMPARE(FakeFtdi::settings().writeTimeout, ULONG(750));
+    QVERIFY(device->isOpen());
+}
+
+/* applySettings() rejects them the same way
+ */
+void TimeoutsTest::negativeRejectedBySettings()
+{
+    FT232Settings settings = device->settings();
+    int readTimeout = settings.readTimeout;
+
+    settings.readTimeout = -1;
+    QVERIFY(!device->applySettings(settings));
+
+    QCOMPARE(device->readTimeout(), readTimeout);
+    QCOMPARE(FakeFtdi::settings().readTimeout, ULONG(readTimeout));
+}
+
+QTEST_GUILESS_MAIN(TimeoutsTest)
+
+#include "tst_timeouts.moc"
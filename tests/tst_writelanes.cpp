@@ -0,0 +1,139 @@
+/* Write priority lanes: a high priority frame overtakes
+ * queued bulk writes at the next write boundary, never
+ * inside a write() or a writeV() group
+ *
+ * The fake device is stalled while the writes are queued,
+ * so the writer thread sits in the first one
+ *
+ */
+
+#include <QtTest>
+
+#include "qft2xx.h"
+#include "fakeftd2xx.h"
+
+/* Bulk write larger than a writer slice */
+static constexpr int LARGE_WRITE        =   256 * 1024;
+
+class WriteLanesTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void overtakesQueuedBulk();
+    void writeVStaysContiguous();
+    void largeWriteNotPreempted();
+
+private:
+    bool waitForWriter();
+    QByteArray resume();
+
+    FT232 *device = nullptr;
+};
+
+void WriteLanesTest::init()
+{
+    FakeFtdi::reset();
+    FakeFtdi::setWriteStalled(true);
+    device = new FT232();
+    device->setPort();
+    device->setBufferedWrite(true);
+    QVERIFY2(device->open(QIODevice::ReadWrite), qPrintable(device->errorString()));
+}
+
+void WriteLanesTest::cleanup()
+{
+    FakeFtdi::setWriteStalled(false);
+    delete device;
+    device = nullptr;
+}
+
+/* Wait until the writer thread is stuck in its first write
+ */
+bool WriteLanesTest::waitForWriter()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (FakeFtdi::calls().write == 0) {
+        if (timer.elapsed() > 5000)
+            return false;
+        QTest::qWait(1);
+    }
+
+    return true;
+}
+
+/* Let the device take data again, returns
+ * everything written once the queue is empty
+ */
+QByteArray WriteLanesTest::resume()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    FakeFtdi::setWriteStalled(false);
+    while (device->bytesToWrite() > 0 && timer.elapsed() < 5000)
+        QTest::qWait(1);
+
+    return FakeFtdi::takeWritten();
+}
+
+/* Written after the bulk write in progress,
+ * before the bulk writes still queued
+ */
+void WriteLanesTest::overtakesQueuedBulk()
+{
+    QByteArray current(1000, 'a');
+    QByteArray queued1(1000, 'b');
+    QByteArray queued2(1000, 'c');
+    QByteArray control("HIGH");
+
+    QCOMPARE(device->write(current), qint64(current.size()));
+    QVERIFY(waitForWriter());
+    QCOMPARE(device->write(queued1), qint64(queued1.size()));
+    QCOMPARE(device->write(queued2), qint64(queued2.size()));
+    QCOMPARE(device->writeWithPriority(control, FT232::HighPriority), qint64(control.size()));
+
+    QCOMPARE(device->queuedBytes(FT232::HighPriority), qint64(control.size()));
+    QCOMPARE(resume(), current + control + queued1 + queued2);
+}
+
+/* The parts of a writeV() go out back to back,
+ * the control frame follows the whole group
+ */
+void WriteLanesTest::writeVStaysContiguous()
+{
+    QList<QByteArray> group = {QByteArray("header"), QByteArray(1000, 'p'), QByteArray("crc")};
+    QByteArray bulk(100, 'b');
+    QByteArray control("HIGH");
+
+    QCOMPARE(device->writeV(group), qint64(1009));
+    QVERIFY(waitForWriter());
+    QCOMPARE(device->write(bulk), qint64(bulk.size()));
+    QCOMPARE(device->writeWithPriority(control, FT232::HighPriority), qint64(control.size()));
+
+    QCOMPARE(resume(), group.at(0) + group.at(1) + group.at(2) + control + bulk);
+}
+
+/* One large bulk write() is not cut by a control frame,
+ * even though it is written in several slices
+ */
+void WriteLanesTest::largeWriteNotPreempted()
+{
+    QByteArray large(LARGE_WRITE, 'L');
+    QByteArray control("HIGH");
+
+    QCOMPARE(device->write(large), qint64(large.size()));
+    QVERIFY(waitForWriter());
+    QCOMPARE(device->writeWithPriority(control, FT232::HighPriority), qint64(control.size()));
+
+    QCOMPARE(resume(), large + control);
+}
+
+QTEST_GUILESS_MAIN(WriteLanesTest)
+
+#include "tst_writelanes.moc"